@@ -9,7 +9,11 @@ class Player {
 		this._marqueeBound = false;
 		this._waveformSocket = null;
 		this._waveformReconnectTimer = null;
-		this._waveformUrl = "ws://127.0.0.1:9450";
+		// 由插件提供頁面時與頁面同源，本機檔案則連預設埠
+		this._waveformUrl = (location.protocol === "http:" || location.protocol === "https:")
+			? "ws://" + location.host
+			: "ws://127.0.0.1:9450";
+		this._waveformBandCount = 12;
 		this._coverCache = {};
 		this._lastCoverKey = null;
 		this._lastCoverUrl = null;
@@ -210,9 +214,17 @@ class Player {
 		}
 		const midNow = container.children('.song-info__time-waveform');
 		if (midNow.length && midNow.children().length === 0) {
-			for (let i = 0; i < 12; i++) {
-				midNow.append('<div class="bar"></div>');
-			}
+			this._buildWaveformBars(midNow, this._waveformBandCount);
+		}
+	}
+
+	_buildWaveformBars(container, count) {
+		container.empty();
+		container[0].style.setProperty("--bar-count", count.toString());
+		// 頻段多時縮小間距，避免 bar 被擠掉
+		container[0].style.setProperty("--bar-gap", count > 24 ? "1px" : "4px");
+		for (let i = 0; i < count; i++) {
+			container.append('<div class="bar"></div>');
 		}
 	}
 
@@ -223,6 +235,7 @@ class Player {
 		const connect = () => {
 			try {
 				const ws = new WebSocket(this._waveformUrl);
+				ws.binaryType = "arraybuffer";
 				this._waveformSocket = ws;
 				ws.onopen = () => {
 					$("body").addClass("has-external-waveform");
@@ -235,6 +248,10 @@ class Player {
 					try { ws.close(); } catch (e) {}
 				};
 				ws.onmessage = (event) => {
+					// binary 訊息（歷史 backfill 等）目前的 widget 用不到
+					if (typeof event.data !== "string") {
+						return;
+					}
 					let payload;
 					try {
 						payload = JSON.parse(event.data);
@@ -244,7 +261,7 @@ class Player {
 					if (!payload || !Array.isArray(payload.bars)) {
 						return;
 					}
-					this.applyExternalWaveform(payload.bars);
+					this.applyExternalWaveform(payload.bars, payload.bands);
 				};
 			} catch (e) {
 				this._scheduleWaveformReconnect();
@@ -262,13 +279,19 @@ class Player {
 		}, 3000);
 	}
 
-	applyExternalWaveform(bars) {
+	applyExternalWaveform(bars, bands) {
 		const container = $(".online .song-info__time .song-info__time-container .song-info__time-waveform");
 		if (!container.length) return;
+		// 插件端可設定頻段數，數量改變時重建 bar
+		const count = (typeof bands === "number" && bands > 0) ? bands : bars.length;
+		if (count !== this._waveformBandCount) {
+			this._waveformBandCount = count;
+			this._buildWaveformBars(container, count);
+		}
 		const barsEls = container.children(".bar");
 		if (!barsEls.length) return;
-		const count = Math.min(barsEls.length, bars.length);
-		for (let i = 0; i < count; i++) {
+		const n = Math.min(barsEls.length, bars.length);
+		for (let i = 0; i < n; i++) {
 			let v = Number(bars[i]);
 			if (!isFinite(v)) v = 0;
 			if (v < 0) v = 0;
@@ -0,0 +1,441 @@
+#include "analysis_pipeline.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+static float clamp_float(float v, float lo, float hi)
+{
+	return v < lo ? lo : (v > hi ? hi : v);
+}
+
+void AnalysisSettings::clamp()
+{
+	gain = clamp_float(gain, 0.1f, 16.0f);
+	noise_floor = clamp_float(noise_floor, 0.0f, 0.1f);
+	attack = clamp_float(attack, 0.0f, 1.0f);
+	release = clamp_float(release, 0.0f, 1.0f);
+	if (band_count < 1)
+		band_count = 1;
+	if (band_count > BandLayout::MAX_BANDS)
+		band_count = BandLayout::MAX_BANDS;
+	if (band_min_freq < 1.0f)
+		band_min_freq = 1.0f;
+	quality_budget = clamp_float(quality_budget, 0.0f, 1.0f);
+}
+
+bool AnalysisSettings::same_bands(const AnalysisSettings &other) const
+{
+	return band_count == other.band_count && band_scale == other.band_scale &&
+	       band_min_freq == other.band_min_freq && band_max_freq == other.band_max_freq &&
+	       band_edges == other.band_edges;
+}
+
+bool AnalysisSettings::same_chroma(const AnalysisSettings &other) const
+{
+	return chroma_a4 == other.chroma_a4 && chroma_min_octave == other.chroma_min_octave &&
+	       chroma_max_octave == other.chroma_max_octave;
+}
+
+// 各視窗 / 抽取組合：fft 長度為完整品質的 1/fft_divisor，decimation 目前只支援 1 或 2
+struct SpectrumShape {
+	unsigned fft_divisor;
+	unsigned decimation;
+};
+
+static const SpectrumShape SPECTRUM_SHAPES[] = {
+	{1, 1},
+	{2, 2}, // 抽取後視窗涵蓋的時間不變，頻率解析度與完整品質相同
+	{4, 2},
+};
+
+// 品質等級：使用哪個分析器、每幾個區塊分析一次、頻段數除以多少
+struct LevelShape {
+	size_t spectrum;
+	unsigned stride;
+	unsigned band_divisor;
+};
+
+static const LevelShape LEVEL_SHAPES[] = {
+	{0, 1, 1}, // 完整品質
+	{0, 2, 1}, // 分析與推送頻率減半
+	{1, 2, 1}, // 2:1 抽取，FFT 減半，約取樣率 1/5 以上的頻段歸零
+	{2, 4, 2}, // 再減半視窗與頻段數，音級只剩粗略的參考價值
+};
+
+static_assert(sizeof(LEVEL_SHAPES) / sizeof(LEVEL_SHAPES[0]) == QualityGovernor::LEVELS,
+	      "one shape per quality level");
+
+// 降級用的頻段：沿用完整品質的邊界，每 band_divisor 個頻段併成一個（最後一個邊界一定保留），
+// 不依較低的 Nyquist 重新分佈，展開回完整數量時每條 bar 仍對應原本的頻率範圍。
+// 抽取後只使用濾波器通帶內的 bin，超出的頻段歸零，而不是把過渡帶的能量堆到最後一個 bin
+static std::shared_ptr<const BandLayout> build_coarse_layout(const BandLayout &full, unsigned band_divisor,
+							     unsigned decimation, float sample_rate, size_t fft_size)
+{
+	const float max_freq = decimation > 1 ? HalfBandDecimator::PASSBAND * sample_rate : 0.5f * sample_rate;
+	const std::vector<float> &edges = full.edges();
+	std::vector<float> coarse;
+	for (size_t i = 0; i < edges.size(); i += band_divisor)
+		coarse.push_back(edges[i]);
+	if (!edges.empty() && (edges.size() - 1) % band_divisor)
+		coarse.push_back(edges.back());
+
+	auto layout = std::make_shared<BandLayout>();
+	layout->build_from_edges(coarse, sample_rate, fft_size, max_freq);
+	return layout;
+}
+
+AnalysisPipeline::AnalysisPipeline()
+{
+	m_bar_levels.assign(BandLayout::MAX_BANDS, 0.0f);
+	m_band_values.assign(BandLayout::MAX_BANDS, 0.0f);
+	m_features.reserve(MAX_FFT_SIZE);
+}
+
+AnalysisPipeline::~AnalysisPipeline()
+{
+	delete m_params.load();
+}
+
+void AnalysisPipeline::configure(const AnalysisSettings &settings, float sample_rate)
+{
+	if (sample_rate <= 0.0f)
+		sample_rate = 48000.0f;
+
+	// 視窗長度約 40ms：48kHz 下為 2048 點
+	size_t fft_size = 256;
+	while ((float)fft_size < sample_rate / 24.0f && fft_size < MAX_FFT_SIZE)
+		fft_size *= 2;
+
+	// m_params 只有這裡會替換，持有鎖時讀取不必經過 hazard pointer
+	std::lock_guard<std::mutex> lock(m_configure_mutex);
+	const AnalysisParams *current = m_params.load(std::memory_order_acquire);
+	const bool same_rate = current && current->sample_rate == sample_rate;
+
+	std::unique_ptr<AnalysisParams> next(new AnalysisParams());
+	next->settings = settings;
+	next->sample_rate = sample_rate;
+
+	// 所有等級的係數都在這裡建好；設定沒變的部分沿用上一份
+	const bool reuse_bands = same_rate && current->settings.same_bands(settings);
+	const bool reuse_chroma = same_rate && current->settings.same_chroma(settings);
+	for (size_t i = 0; i < QualityGovernor::LEVELS; ++i) {
+		const LevelShape &shape = LEVEL_SHAPES[i];
+		const SpectrumShape &spectrum = SPECTRUM_SHAPES[shape.spectrum];
+		AnalysisLevel &level = next->levels[i];
+		level.fft_size = fft_size / spectrum.fft_divisor;
+		level.decimation = spectrum.decimation;
+		level.stride = shape.stride;
+		// 純音的功率與視窗點數成正比，短視窗要放大回來
+		level.power_scale = (float)spectrum.fft_divisor;
+		const float rate = sample_rate / (float)spectrum.decimation;
+
+		const LevelShape *prev_shape = i > 0 ? &LEVEL_SHAPES[i - 1] : nullptr;
+		const AnalysisLevel *prev = i > 0 ? &next->levels[i - 1] : nullptr;
+		const bool same_spectrum = prev_shape && prev_shape->spectrum == shape.spectrum;
+
+		if (reuse_bands) {
+			level.layout = current->levels[i].layout;
+		} else if (same_spectrum && prev_shape->band_divisor == shape.band_divisor) {
+			level.layout = prev->layout;
+		} else if (i == 0) {
+			auto layout = std::make_shared<BandLayout>();
+			layout->build(settings.band_count, settings.band_scale, settings.band_min_freq,
+				      settings.band_max_freq, settings.band_edges, rate, level.fft_size);
+			level.layout = std::move(layout);
+		} else {
+			level.layout = build_coarse_layout(*next->levels[0].layout, shape.band_divisor,
+							   spectrum.decimation, rate, level.fft_size);
+		}
+
+		if (reuse_chroma) {
+			level.chroma = current->levels[i].chroma;
+		} else if (same_spectrum) {
+			level.chroma = prev->chroma;
+		} else {
+			auto chroma = std::make_shared<ChromaKernel>();
+			chroma->build(rate, level.fft_size, settings.chroma_a4, settings.chroma_min_octave,
+				      settings.chroma_max_octave);
+			level.chroma = std::move(chroma);
+		}
+	}
+	next->band_count = next->levels[0].layout->band_count();
+
+	const AnalysisParams *previous = m_params.exchange(next.release(), std::memory_order_seq_cst);
+	if (previous)
+		m_retired.emplace_back(previous);
+	collect_locked();
+}
+
+void AnalysisPipeline::collect_locked()
+{
+	// 音訊執行緒最多只握著一個區塊；m_params 已換掉，之後它只會拿到新的
+	const AnalysisParams *busy = m_in_use.load(std::memory_order_seq_cst);
+	m_retired.erase(std::remove_if(m_retired.begin(), m_retired.end(),
+				       [busy](const std::unique_ptr<const AnalysisParams> &p) { return p.get() != busy; }),
+			m_retired.end());
+}
+
+namespace {
+
+// 音訊執行緒在整個區塊期間標記正在使用的參數區塊，離開時清除
+class ParamsGuard {
+public:
+	ParamsGuard(std::atomic<const AnalysisParams *> &current, std::atomic<const AnalysisParams *> &in_use)
+		: m_in_use(in_use)
+	{
+		// 標記後再確認一次仍是目前的區塊，否則控制執行緒可能已把它釋放
+		const AnalysisParams *p = current.load(std::memory_order_seq_cst);
+		for (;;) {
+			m_in_use.store(p, std::memory_order_seq_cst);
+			const AnalysisParams *again = current.load(std::memory_order_seq_cst);
+			if (again == p)
+				break;
+			p = again;
+		}
+		m_params = p;
+	}
+	~ParamsGuard() { m_in_use.store(nullptr, std::memory_order_release); }
+
+	const AnalysisParams *get() const { return m_params; }
+
+private:
+	std::atomic<const AnalysisParams *> &m_in_use;
+	const AnalysisParams *m_params = nullptr;
+};
+
+} // namespace
+
+void AnalysisPipeline::push_samples(const AnalysisParams &params, const float *mono, size_t frames)
+{
+	// 固定完整品質時降級用的分析器與抽取都用不到，不必在音訊執行緒上白算。
+	// 重新啟用調節時它們停在停用前的內容，清掉重新累積
+	const size_t full = LEVEL_SHAPES[0].spectrum;
+	const bool reduced = m_governor.enabled();
+	if (reduced && !m_reduced_fed) {
+		for (size_t i = 0; i < SPECTRA; ++i) {
+			if (i != full)
+				m_spectra[i].reset();
+		}
+		m_decimator.reset();
+	}
+	m_reduced_fed = reduced;
+
+	for (size_t i = 0; i < SPECTRA; ++i) {
+		const SpectrumShape &shape = SPECTRUM_SHAPES[i];
+		SpectrumAnalyzer &spectrum = m_spectra[i];
+		// FFT 長度跟著參數走（只在第一個區塊或取樣率改變時才會發生）
+		const size_t fft_size = params.levels[0].fft_size / shape.fft_divisor;
+		if (spectrum.fft_size() != fft_size)
+			spectrum.configure(fft_size);
+		if (shape.decimation == 1 && (reduced || i == full))
+			spectrum.push(mono, frames);
+	}
+	if (!reduced)
+		return;
+
+	// 2:1 抽取只做一次，同一份結果餵給所有抽取過的分析器（濾波器狀態與相位只有一份）。
+	// 分段處理，暫存在堆疊上，不配置記憶體
+	float chunk[256];
+	const size_t max_in = 2 * (sizeof(chunk) / sizeof(chunk[0]));
+	for (size_t offset = 0; offset < frames; offset += max_in) {
+		const size_t count = std::min(frames - offset, max_in);
+		const size_t n = m_decimator.process(mono + offset, count, chunk);
+		if (!n)
+			continue;
+		for (size_t i = 0; i < SPECTRA; ++i) {
+			if (SPECTRUM_SHAPES[i].decimation == 2)
+				m_spectra[i].push(chunk, n);
+		}
+	}
+}
+
+bool AnalysisPipeline::process(const float *mono, size_t frames, bool want_chroma, bool want_features,
+			       AnalysisFrame *out)
+{
+	if (!mono || frames == 0)
+		return false;
+
+	ParamsGuard guard(m_params, m_in_use);
+	const AnalysisParams *params = guard.get();
+	if (!params)
+		return false;
+	const auto start = std::chrono::steady_clock::now();
+
+	m_governor.set_budget(params->settings.quality_budget);
+	const int level_index = m_governor.level();
+	const AnalysisLevel &level = params->levels[level_index];
+	const BandLayout &layout = *level.layout;
+	const ChromaKernel &chroma_kernel = *level.chroma;
+	const float gain = params->settings.gain;
+	const float noise_floor = params->settings.noise_floor;
+	float attack = params->settings.attack;
+	float release = params->settings.release;
+
+	// 全局 RMS（可用於附加用途），特徵用的峰值與過零數在同一個迴圈中累加
+	float sum_sq = 0.0f;
+	float peak = 0.0f;
+	size_t crossings = 0;
+	float last = m_needs_reset ? 0.0f : m_last_sample;
+	for (size_t i = 0; i < frames; ++i) {
+		float v = mono[i];
+		sum_sq += v * v;
+		const float a = fabsf(v);
+		peak = a > peak ? a : peak;
+		crossings += (v < 0.0f) != (last < 0.0f);
+		last = v;
+	}
+	m_last_sample = last;
+	float rms = sqrtf(sum_sq / (float)frames);
+
+	// 頻段數改變後舊的 bar 對不上，視同重置
+	const size_t band_count = params->band_count;
+	if (band_count != m_band_count) {
+		m_band_count = band_count;
+		m_needs_reset = true;
+	}
+
+	if (m_needs_reset) {
+		for (SpectrumAnalyzer &spectrum : m_spectra)
+			spectrum.reset();
+		m_decimator.reset();
+		m_stride_count = 0;
+		m_governor.reset();
+	}
+	push_samples(*params, mono, frames);
+
+	// 降級時每 stride 個區塊才分析一次（重置後的第一個區塊一定分析）
+	if (!m_needs_reset && ++m_stride_count < level.stride)
+		return false;
+	m_stride_count = 0;
+	if (level.stride > 1) {
+		// 平滑係數是以「每次分析」計算的，跳過的區塊要一併補上
+		attack = 1.0f - powf(1.0f - attack, (float)level.stride);
+		release = 1.0f - powf(1.0f - release, (float)level.stride);
+	}
+
+	// 靜音偵測：加窗後 |X|^2 / sum(w) 不會超過 0.75 * 視窗能量（Cauchy-Schwarz，Hann 窗），
+	// 所以低於噪聲門檻時每個頻段都必然被歸零，可以略過整個 FFT。
+	SpectrumAnalyzer &spectrum = m_spectra[LEVEL_SHAPES[level_index].spectrum];
+	const float band_gain = gain * level.power_scale;
+	const bool below_floor = 0.75f * spectrum.window_energy() * band_gain <= noise_floor;
+	const float *power = below_floor ? nullptr : spectrum.compute();
+
+	const bool was_reset = m_needs_reset;
+	if (m_needs_reset) {
+		m_needs_reset = false;
+		m_level = 0.0f;
+		std::fill(m_bar_levels.begin(), m_bar_levels.end(), 0.0f);
+		m_chroma_levels.fill(0.0f);
+		m_features.reset();
+		m_silent = true;
+	}
+
+	// 已歸零且仍在噪聲門檻下：連平滑都不必再算
+	// （剛重置時仍要送出一幀歸零的 bar，蓋掉閒置前留在伺服器的舊資料）
+	if (below_floor && m_silent && !was_reset)
+		return false;
+
+	// 更新全局 m_level（保留原有行為）
+	{
+		float level_lin = rms * gain;
+		if (level_lin < noise_floor)
+			level_lin = 0.0f;
+		if (level_lin > 1.0f)
+			level_lin = 1.0f;
+		float rms_level = std::sqrt(level_lin);
+		if (rms_level > m_level)
+			m_level = m_level * (1.0f - attack) + rms_level * attack;
+		else
+			m_level = m_level * (1.0f - release) + rms_level * release;
+	}
+
+	// 依照頻段能量更新每條 bar 的值；降級時相鄰頻段合併計算，再展開回完整數量
+	const unsigned band_divisor = LEVEL_SHAPES[level_index].band_divisor;
+	if (power) {
+		layout.apply(power, m_band_values.data());
+		if (band_divisor > 1) {
+			// 由後往前展開，來源索引不會大於目的索引，可以原地進行
+			for (size_t b = band_count; b-- > 0;)
+				m_band_values[b] = m_band_values[b / band_divisor];
+		}
+	} else {
+		std::fill(m_band_values.begin(), m_band_values.begin() + band_count, 0.0f);
+	}
+	for (size_t b = 0; b < band_count; ++b) {
+		float v = m_band_values[b] * band_gain;
+		if (v < noise_floor)
+			v = 0.0f;
+		if (v > 1.0f)
+			v = 1.0f;
+		v = std::sqrt(v);
+		float &cur = m_bar_levels[b];
+		if (v > cur)
+			cur = cur * (1.0f - attack) + v * attack;
+		else
+			cur = cur * (1.0f - release) + v * release;
+	}
+
+	// 音級：沿用同一份功率譜，只掃描八度範圍內的 bin
+	if (want_chroma) {
+		if (power)
+			chroma_kernel.apply(power, m_chroma_values.data());
+		else
+			m_chroma_values.fill(0.0f);
+		for (size_t i = 0; i < m_chroma_levels.size(); ++i) {
+			float v = m_chroma_values[i];
+			float &cur = m_chroma_levels[i];
+			if (v > cur)
+				cur = cur * (1.0f - attack) + v * attack;
+			else
+				cur = cur * (1.0f - release) + v * release;
+		}
+	}
+
+	// 特徵描述：直接取這一幀的值，不做平滑（前端可依用途自行平滑）
+	if (want_features) {
+		const float rate = params->sample_rate / (float)level.decimation;
+		m_features.compute(power, level.fft_size, rate, rms, peak, crossings, frames, m_feature_values.data());
+		if (!power)
+			m_feature_values.fill(0.0f);
+	} else {
+		m_features.reset();
+		m_feature_values.fill(0.0f);
+	}
+
+	// release 衰減到聽不見的程度就直接歸零，進入靜音狀態
+	if (below_floor) {
+		bool settled = true;
+		for (size_t b = 0; b < band_count; ++b) {
+			if (m_bar_levels[b] > 1e-3f) {
+				settled = false;
+				break;
+			}
+		}
+		if (settled) {
+			m_level = 0.0f;
+			std::fill(m_bar_levels.begin(), m_bar_levels.end(), 0.0f);
+			m_chroma_levels.fill(0.0f);
+			m_silent = true;
+		}
+	} else {
+		m_silent = false;
+	}
+
+	if (out) {
+		out->silent = m_silent;
+		out->band_count = band_count;
+		std::copy(m_bar_levels.begin(), m_bar_levels.begin() + band_count, out->bars.begin());
+		out->chroma = m_chroma_levels;
+		out->features = m_feature_values;
+	}
+
+	// 只以真的跑了 FFT 的區塊評估負載，靜音時不會誤判為有餘裕而升級
+	if (power) {
+		const double cost = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		const double audio = (double)(frames * level.stride) / (double)params->sample_rate;
+		m_quality.store(m_governor.report(cost, audio), std::memory_order_relaxed);
+		m_load.store(m_governor.load(), std::memory_order_relaxed);
+	}
+	return true;
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "band_layout.hpp"
+#include "chroma.hpp"
+#include "decimator.hpp"
+#include "features.hpp"
+#include "frame_delay_line.hpp"
+#include "quality_governor.hpp"
+#include "spectrum.hpp"
+
+// 分析參數：OBS 來源屬性與獨立 daemon 的命令列都會整理成這份設定
+struct AnalysisSettings {
+	float gain = 3.0f;
+	float noise_floor = 0.0005f;
+	float attack = 0.7f;
+	float release = 0.3f;
+
+	size_t band_count = 12;
+	BandScale band_scale = BandScale::Log;
+	float band_min_freq = 45.0f;
+	float band_max_freq = 12500.0f;
+	std::vector<float> band_edges;
+
+	float chroma_a4 = 440.0f;
+	int chroma_min_octave = 2;
+	int chroma_max_octave = 7;
+
+	// 分析耗時上限（佔音訊即時長度的比例），超過時自動降低品質；0 為固定完整品質
+	float quality_budget = 0.1f;
+
+	// 把超出範圍的值夾回可用區間
+	void clamp();
+
+	// 用來判斷設定變更時哪些係數需要重建
+	bool same_bands(const AnalysisSettings &other) const;
+	bool same_chroma(const AnalysisSettings &other) const;
+};
+
+// 某個品質等級實際使用的視窗、抽取與係數
+struct AnalysisLevel {
+	size_t fft_size = 0;
+	unsigned decimation = 1; // 抽取倍率：經半頻帶 FIR 低通後每幾個取一個送進 FFT（見 decimator.hpp）
+	unsigned stride = 1;     // 每幾個區塊分析一次
+	float power_scale = 1.0f; // 補償較短視窗的功率刻度，讓各等級的 bar 高度一致
+	std::shared_ptr<const BandLayout> layout; // 頻段可能比設定少，輸出時展開回完整數量
+	std::shared_ptr<const ChromaKernel> chroma;
+};
+
+// 不可變的參數區塊：控制執行緒建好後整份發佈給音訊執行緒，發佈後不再修改。
+// 頻段與音級係數以 shared_ptr 持有，只改增益 / 平滑時直接沿用上一份，不必重建。
+// 所有品質等級的係數都預先建好，降級時音訊執行緒只需切換索引。
+struct AnalysisParams {
+	AnalysisSettings settings;
+	float sample_rate = 0.0f;
+	size_t band_count = 0; // 完整品質的頻段數，也是輸出的頻段數
+	std::array<AnalysisLevel, QualityGovernor::LEVELS> levels;
+};
+
+// 單聲道樣本 -> 頻譜 bar / 音級的完整分析流程，不依賴 OBS。
+// configure() 在控制執行緒（OBS 的 update / daemon 主程式）呼叫，process() 在音訊執行緒呼叫。
+// 兩者之間不上鎖：新參數在控制執行緒建好後以單一指標原子地交換，
+// 音訊執行緒用 hazard pointer 標記正在使用的區塊，舊區塊一律由控制執行緒釋放。
+// 多個控制執行緒之間則以 m_configure_mutex 排隊，音訊執行緒從不碰它。
+
+class AnalysisPipeline {
+public:
+	// 完整品質的視窗長度上限（384kHz 約 40ms），需要它的緩衝在建構時一次配置好
+	static const size_t MAX_FFT_SIZE = 16384;
+
+	AnalysisPipeline();
+	// 需在音訊執行緒停止呼叫 process() 之後解構
+	~AnalysisPipeline();
+
+	AnalysisPipeline(const AnalysisPipeline &) = delete;
+	AnalysisPipeline &operator=(const AnalysisPipeline &) = delete;
+
+	// 控制執行緒：只重建有變動的係數，再發佈新的參數區塊。
+	// 可從多個執行緒同時呼叫：沒有 video 旗標的來源，obs_source_update 會在呼叫端
+	// （UI、腳本、obs-websocket）的執行緒上直接執行 update
+	void configure(const AnalysisSettings &settings, float sample_rate);
+
+	// 音訊執行緒：下一個區塊開始前清掉平滑狀態（例如閒置後恢復分析）
+	void request_reset() { m_needs_reset = true; }
+
+	// 音訊執行緒：分析一個區塊。需要送出新的一幀時回傳 true，並在 out 不為 nullptr 時填好
+	// （timestamp 由呼叫端負責）。已歸零且仍低於噪聲門檻時回傳 false，連平滑都不必再算。
+	// want_chroma / want_features 為 false 時對應的欄位填 0，不計算
+	bool process(const float *mono, size_t frames, bool want_chroma, bool want_features, AnalysisFrame *out);
+
+	// 任何執行緒：目前的品質等級（0 為完整）與平均負載，供日誌與用戶端顯示
+	int quality() const { return m_quality.load(std::memory_order_relaxed); }
+	float load() const { return m_load.load(std::memory_order_relaxed); }
+
+private:
+	std::atomic<const AnalysisParams *> m_params{nullptr}; // 目前發佈的區塊，由 configure() 擁有
+	std::atomic<const AnalysisParams *> m_in_use{nullptr}; // 音訊執行緒正在讀的區塊（hazard pointer）
+	std::mutex m_configure_mutex; // 控制執行緒之間：保護 m_params 的替換與 m_retired
+	std::vector<std::unique_ptr<const AnalysisParams>> m_retired;
+
+	// 釋放音訊執行緒已不再讀取的舊區塊，需持有 m_configure_mutex
+	void collect_locked();
+
+	void push_samples(const AnalysisParams &params, const float *mono, size_t frames);
+
+	std::atomic<int> m_quality{0};
+	std::atomic<float> m_load{0.0f};
+
+	// 以下僅音訊執行緒使用
+	// 每種視窗 / 抽取組合一個分析器，全部持續餵資料，換級時視窗已經是滿的。
+	// 調節停用（預算 0）時只餵完整品質的分析器
+	static const size_t SPECTRA = 3;
+	std::array<SpectrumAnalyzer, SPECTRA> m_spectra;
+	HalfBandDecimator m_decimator; // 所有 2:1 抽取的分析器共用
+	bool m_reduced_fed = false;    // 上一個區塊是否也餵了降級用的分析器
+	QualityGovernor m_governor;
+	unsigned m_stride_count = 0;
+	std::vector<float> m_band_values; // 固定配置 BandLayout::MAX_BANDS 個
+	std::array<float, ChromaKernel::PITCH_CLASSES> m_chroma_values{};
+	FeatureExtractor m_features;
+	std::array<float, FEATURE_COUNT> m_feature_values{};
+	float m_last_sample = 0.0f; // 上一個區塊的最後一個樣本，跨區塊計算過零
+	bool m_needs_reset = true;
+
+	float m_level = 0.0f; // 0..1 之間的音量估計
+	std::vector<float> m_bar_levels; // 固定配置 BandLayout::MAX_BANDS 個
+	std::array<float, ChromaKernel::PITCH_CLASSES> m_chroma_levels{};
+	size_t m_band_count = 0; // 上一個區塊的頻段數，改變時清掉舊的 bar
+	bool m_silent = false;   // bar 已全部歸零
+};
@@ -0,0 +1,162 @@
+#include "asset_cache.hpp"
+
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+#include <zlib.h>
+#ifdef HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+namespace fs = std::filesystem;
+
+static const char *content_type_for(const std::string &ext)
+{
+	if (ext == ".html" || ext == ".htm")
+		return "text/html; charset=utf-8";
+	if (ext == ".css")
+		return "text/css; charset=utf-8";
+	if (ext == ".js")
+		return "application/javascript; charset=utf-8";
+	if (ext == ".json")
+		return "application/json; charset=utf-8";
+	if (ext == ".svg")
+		return "image/svg+xml";
+	if (ext == ".png")
+		return "image/png";
+	if (ext == ".jpg" || ext == ".jpeg")
+		return "image/jpeg";
+	if (ext == ".ico")
+		return "image/x-icon";
+	if (ext == ".woff")
+		return "font/woff";
+	if (ext == ".woff2")
+		return "font/woff2";
+	return "application/octet-stream";
+}
+
+// 已經是壓縮格式的檔案不必再壓
+static bool is_compressible(const std::string &ext)
+{
+	return !(ext == ".woff2" || ext == ".png" || ext == ".jpg" || ext == ".jpeg");
+}
+
+// FNV-1a 64-bit，只用來產生 ETag
+static uint64_t fnv1a64(const std::string &data)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	for (unsigned char c : data) {
+		h ^= c;
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+static std::string gzip_compress(const std::string &src)
+{
+	z_stream zs{};
+	// windowBits 15 + 16 = 輸出 gzip 格式
+	if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+		return std::string();
+
+	std::string out;
+	out.resize(deflateBound(&zs, (uLong)src.size()) + 32);
+	zs.next_in = (Bytef *)src.data();
+	zs.avail_in = (uInt)src.size();
+	zs.next_out = (Bytef *)&out[0];
+	zs.avail_out = (uInt)out.size();
+	int ret = deflate(&zs, Z_FINISH);
+	size_t produced = out.size() - zs.avail_out;
+	deflateEnd(&zs);
+	if (ret != Z_STREAM_END)
+		return std::string();
+	out.resize(produced);
+	return out;
+}
+
+static std::string brotli_compress(const std::string &src)
+{
+#ifdef HAVE_BROTLI
+	size_t out_size = BrotliEncoderMaxCompressedSize(src.size());
+	if (!out_size)
+		return std::string();
+	std::string out;
+	out.resize(out_size);
+	if (!BrotliEncoderCompress(BROTLI_MAX_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, src.size(),
+				   (const uint8_t *)src.data(), &out_size, (uint8_t *)&out[0]))
+		return std::string();
+	out.resize(out_size);
+	return out;
+#else
+	(void)src;
+	return std::string();
+#endif
+}
+
+size_t AssetCache::load_directory(const std::string &root)
+{
+	m_assets.clear();
+
+	std::error_code ec;
+	fs::path base(root);
+	if (!fs::is_directory(base, ec))
+		return 0;
+
+	for (fs::recursive_directory_iterator it(base, ec), end; !ec && it != end; it.increment(ec)) {
+		if (!it->is_regular_file(ec))
+			continue;
+
+		std::ifstream in(it->path(), std::ios::binary);
+		if (!in)
+			continue;
+
+		WebAsset asset;
+		asset.identity.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+
+		std::string ext = it->path().extension().string();
+		for (char &c : ext)
+			c = (char)tolower((unsigned char)c);
+		asset.content_type = content_type_for(ext);
+		// 所有檔案都用 ETag 重新驗證（304 很便宜）：URL 不帶版本，長時間快取會讓
+		// 更新插件後的新 HTML 配上舊的 JS，而協議在版本之間會改變
+		asset.cache_control = "no-cache";
+
+		char tag[32];
+		snprintf(tag, sizeof(tag), "%016llx", (unsigned long long)fnv1a64(asset.identity));
+		asset.etag = std::string("\"") + tag + "\"";
+
+		if (is_compressible(ext)) {
+			// 壓縮後至少省下 5% 才保留
+			const size_t limit = asset.identity.size() - asset.identity.size() / 20;
+			asset.gzip = gzip_compress(asset.identity);
+			if (asset.gzip.size() >= limit)
+				asset.gzip.clear();
+			asset.brotli = brotli_compress(asset.identity);
+			if (asset.brotli.size() >= limit)
+				asset.brotli.clear();
+		}
+
+		std::string url = "/" + fs::relative(it->path(), base, ec).generic_string();
+		m_assets[url] = std::move(asset);
+	}
+
+	return m_assets.size();
+}
+
+const WebAsset *AssetCache::find(const std::string &path) const
+{
+	auto it = m_assets.find(path == "/" ? std::string("/index.html") : path);
+	return it == m_assets.end() ? nullptr : &it->second;
+}
+
+size_t AssetCache::memory_usage() const
+{
+	size_t total = 0;
+	for (const auto &kv : m_assets)
+		total += kv.second.identity.size() + kv.second.gzip.size() + kv.second.brotli.size();
+	return total;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+
+// 前端 widget 的靜態檔案快取：啟動時一次讀進記憶體，並預先產生 gzip / brotli 版本，
+// 之後每個請求只是查表 + 送出，不再碰磁碟。
+
+struct WebAsset {
+	std::string content_type;
+	std::string cache_control;
+	std::string etag;     // 原始內容的強 ETag（含引號）；壓縮版本另加 -gz / -br 後綴
+	std::string identity;
+	std::string gzip;     // 壓縮後沒有變小時留空
+	std::string brotli;
+};
+
+class AssetCache {
+public:
+	// 遞迴載入 root 下所有檔案，URL 路徑為相對 root 的 "/..."，回傳載入的檔案數
+	size_t load_directory(const std::string &root);
+
+	// path 需已去掉 query string；"/" 對應 "/index.html"
+	const WebAsset *find(const std::string &path) const;
+
+	bool empty() const { return m_assets.empty(); }
+	size_t memory_usage() const;
+
+private:
+	std::unordered_map<std::string, WebAsset> m_assets;
+};
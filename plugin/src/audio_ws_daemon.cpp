@@ -0,0 +1,552 @@
+// 獨立的無介面分析 daemon：從 stdin / FIFO / WAV 讀取 PCM，
+// 執行與 OBS 插件相同的分析，並以相同的 HTTP / WebSocket 協議提供資料。
+//
+//   pw-record --format f32 --rate 48000 --channels 2 - | audio-ws-daemon --bind 0.0.0.0
+//   arecord -f S16_LE -r 48000 -c 2 -t wav | audio-ws-daemon --frontend ./frontend
+//   audio-ws-daemon --bench song.wav
+
+#include "analysis_pipeline.hpp"
+#include "frame_delay_line.hpp"
+#include "log.hpp"
+#include "pcm_reader.hpp"
+#include "websocket_server.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
+
+static std::atomic<bool> g_stop{false};
+static int g_log_level = LOG_INFO;
+
+void blog(int log_level, const char *format, ...)
+{
+	if (log_level > g_log_level)
+		return;
+	const char *tag = "debug";
+	if (log_level <= LOG_ERROR)
+		tag = "error";
+	else if (log_level <= LOG_WARNING)
+		tag = "warning";
+	else if (log_level <= LOG_INFO)
+		tag = "info";
+	fprintf(stderr, "[%s] ", tag);
+	va_list args;
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+	fputc('\n', stderr);
+}
+
+static uint64_t now_ns()
+{
+	// 與 os_gettime_ns 相同，Linux 上都是 CLOCK_MONOTONIC
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		       std::chrono::steady_clock::now().time_since_epoch())
+		.count();
+}
+
+static void handle_signal(int)
+{
+	g_stop.store(true);
+}
+
+struct DaemonOptions {
+	std::string input = "-";
+	PcmFormat format;
+	size_t block_frames = 1024;
+
+	std::string bind_address = "127.0.0.1";
+	uint16_t port = 9450;
+	std::string frontend;
+	double history_seconds = 30.0;
+	int history_bits = 8;
+	int64_t delay_ms = 0;
+
+	AnalysisSettings analysis;
+	int realtime = -1; // -1：一般檔案才節流
+	bool loop = false;
+	bool bench = false;
+};
+
+// 分析耗時統計，供 --bench 與結束時的日誌使用
+struct BlockStats {
+	uint64_t blocks = 0;
+	uint64_t frames = 0;
+	uint64_t total_ns = 0;
+	uint64_t max_ns = 0;
+
+	void add(size_t block_frames, uint64_t cost_ns)
+	{
+		++blocks;
+		frames += block_frames;
+		total_ns += cost_ns;
+		if (cost_ns > max_ns)
+			max_ns = cost_ns;
+	}
+};
+
+static void usage(FILE *out)
+{
+	fprintf(out,
+		"usage: audio-ws-daemon [options] [input]\n"
+		"\n"
+		"Reads PCM from input (file, FIFO or - for stdin; default -) and serves the\n"
+		"spectrum over HTTP/WebSocket, like the OBS plugin. WAV headers are detected\n"
+		"automatically and override the raw format options.\n"
+		"\n"
+		"input:\n"
+		"  -r, --rate HZ            sample rate of raw PCM (48000)\n"
+		"  -c, --channels N         channel count of raw PCM (2)\n"
+		"  -f, --format FMT         f32 or s16, little endian (f32)\n"
+		"      --planar             channels are stored one after another per block\n"
+		"  -b, --block FRAMES       frames per analysis block (1024)\n"
+		"      --realtime           pace input to the sample rate (default for files)\n"
+		"      --no-realtime        read as fast as the input delivers\n"
+		"      --loop               restart regular files at EOF (soak testing)\n"
+		"\n"
+		"server:\n"
+		"  -p, --port N             listen port (9450)\n"
+		"      --bind ADDR          listen address (127.0.0.1)\n"
+		"      --frontend DIR       serve the widget from DIR\n"
+		"      --history SECONDS    spectrum history for new clients, 0 = off (30)\n"
+		"      --history-bits N     8 or 16 (8)\n"
+		"      --delay MS           extra visual delay, 0 or more (0)\n"
+		"\n"
+		"analysis:\n"
+		"      --bands N            band count, 1-%d (12)\n"
+		"      --scale NAME         log, mel, bark or custom (log)\n"
+		"      --min-freq HZ        lowest frequency (45)\n"
+		"      --max-freq HZ        highest frequency (12500)\n"
+		"      --edges LIST         custom band edges in Hz, e.g. \"40,80,160,320\"\n"
+		"      --gain X             (3.0)\n"
+		"      --noise-floor X      (0.0005)\n"
+		"      --attack X           0-1 (0.7)\n"
+		"      --release X          0-1 (0.3)\n"
+		"      --a4 HZ              chroma tuning reference (440)\n"
+		"      --budget PCT         analysis CPU budget in %% of real time; lower\n"
+		"                           the quality when exceeded, 0 = fixed (10)\n"
+		"\n"
+		"  -B, --bench              no server: analyze the whole input as fast as\n"
+		"                           possible and print timing statistics\n"
+		"  -v, --verbose            debug logging\n"
+		"  -h, --help\n",
+		(int)BandLayout::MAX_BANDS);
+}
+
+static bool parse_number(const char *name, const char *text, double &out, double lo = -1e9, double hi = 1e9)
+{
+	char *end = nullptr;
+	out = strtod(text, &end);
+	if (!end || end == text || *end != '\0' || out < lo || out > hi) {
+		fprintf(stderr, "invalid value for --%s: %s\n", name, text);
+		return false;
+	}
+	return true;
+}
+
+static bool parse_options(int argc, char **argv, DaemonOptions &opt)
+{
+	enum {
+		OPT_PLANAR = 256,
+		OPT_REALTIME,
+		OPT_NO_REALTIME,
+		OPT_LOOP,
+		OPT_BIND,
+		OPT_FRONTEND,
+		OPT_HISTORY,
+		OPT_HISTORY_BITS,
+		OPT_DELAY,
+		OPT_BANDS,
+		OPT_SCALE,
+		OPT_MIN_FREQ,
+		OPT_MAX_FREQ,
+		OPT_EDGES,
+		OPT_GAIN,
+		OPT_NOISE_FLOOR,
+		OPT_ATTACK,
+		OPT_RELEASE,
+		OPT_A4,
+		OPT_BUDGET,
+	};
+	static const option long_options[] = {
+		{"rate", required_argument, nullptr, 'r'},
+		{"channels", required_argument, nullptr, 'c'},
+		{"format", required_argument, nullptr, 'f'},
+		{"planar", no_argument, nullptr, OPT_PLANAR},
+		{"block", required_argument, nullptr, 'b'},
+		{"realtime", no_argument, nullptr, OPT_REALTIME},
+		{"no-realtime", no_argument, nullptr, OPT_NO_REALTIME},
+		{"loop", no_argument, nullptr, OPT_LOOP},
+		{"port", required_argument, nullptr, 'p'},
+		{"bind", required_argument, nullptr, OPT_BIND},
+		{"frontend", required_argument, nullptr, OPT_FRONTEND},
+		{"history", required_argument, nullptr, OPT_HISTORY},
+		{"history-bits", required_argument, nullptr, OPT_HISTORY_BITS},
+		{"delay", required_argument, nullptr, OPT_DELAY},
+		{"bands", required_argument, nullptr, OPT_BANDS},
+		{"scale", required_argument, nullptr, OPT_SCALE},
+		{"min-freq", required_argument, nullptr, OPT_MIN_FREQ},
+		{"max-freq", required_argument, nullptr, OPT_MAX_FREQ},
+		{"edges", required_argument, nullptr, OPT_EDGES},
+		{"gain", required_argument, nullptr, OPT_GAIN},
+		{"noise-floor", required_argument, nullptr, OPT_NOISE_FLOOR},
+		{"attack", required_argument, nullptr, OPT_ATTACK},
+		{"release", required_argument, nullptr, OPT_RELEASE},
+		{"a4", required_argument, nullptr, OPT_A4},
+		{"budget", required_argument, nullptr, OPT_BUDGET},
+		{"bench", no_argument, nullptr, 'B'},
+		{"verbose", no_argument, nullptr, 'v'},
+		{"help", no_argument, nullptr, 'h'},
+		{nullptr, 0, nullptr, 0},
+	};
+
+	int c;
+	double v = 0.0;
+	while ((c = getopt_long(argc, argv, "r:c:f:b:p:Bvh", long_options, nullptr)) != -1) {
+		switch (c) {
+		case 'r':
+			if (!parse_number("rate", optarg, v, 1000.0, 384000.0))
+				return false;
+			opt.format.sample_rate = (uint32_t)v;
+			break;
+		case 'c':
+			if (!parse_number("channels", optarg, v, 1.0, 64.0))
+				return false;
+			opt.format.channels = (uint32_t)v;
+			break;
+		case 'f':
+			if (strcmp(optarg, "f32") == 0) {
+				opt.format.sample_format = PcmSampleFormat::F32;
+			} else if (strcmp(optarg, "s16") == 0) {
+				opt.format.sample_format = PcmSampleFormat::S16;
+			} else {
+				fprintf(stderr, "unknown sample format: %s\n", optarg);
+				return false;
+			}
+			break;
+		case OPT_PLANAR:
+			opt.format.planar = true;
+			break;
+		case 'b':
+			if (!parse_number("block", optarg, v, 16.0, 65536.0))
+				return false;
+			opt.block_frames = (size_t)v;
+			break;
+		case OPT_REALTIME:
+			opt.realtime = 1;
+			break;
+		case OPT_NO_REALTIME:
+			opt.realtime = 0;
+			break;
+		case OPT_LOOP:
+			opt.loop = true;
+			break;
+		case 'p':
+			if (!parse_number("port", optarg, v, 1.0, 65535.0))
+				return false;
+			opt.port = (uint16_t)v;
+			break;
+		case OPT_BIND:
+			opt.bind_address = optarg;
+			break;
+		case OPT_FRONTEND:
+			opt.frontend = optarg;
+			break;
+		case OPT_HISTORY:
+			if (!parse_number("history", optarg, opt.history_seconds))
+				return false;
+			break;
+		case OPT_HISTORY_BITS:
+			if (!parse_number("history-bits", optarg, v))
+				return false;
+			opt.history_bits = (int)v;
+			break;
+		case OPT_DELAY:
+			if (!parse_number("delay", optarg, v, 0.0, 60000.0))
+				return false;
+			opt.delay_ms = (int64_t)v;
+			break;
+		case OPT_BANDS:
+			if (!parse_number("bands", optarg, v, 1.0, (double)BandLayout::MAX_BANDS))
+				return false;
+			opt.analysis.band_count = (size_t)v;
+			break;
+		case OPT_SCALE:
+			opt.analysis.band_scale = BandLayout::parse_scale(optarg);
+			break;
+		case OPT_MIN_FREQ:
+			if (!parse_number("min-freq", optarg, v))
+				return false;
+			opt.analysis.band_min_freq = (float)v;
+			break;
+		case OPT_MAX_FREQ:
+			if (!parse_number("max-freq", optarg, v))
+				return false;
+			opt.analysis.band_max_freq = (float)v;
+			break;
+		case OPT_EDGES:
+			opt.analysis.band_edges = BandLayout::parse_edges(optarg);
+			opt.analysis.band_scale = BandScale::Custom;
+			break;
+		case OPT_GAIN:
+			if (!parse_number("gain", optarg, v))
+				return false;
+			opt.analysis.gain = (float)v;
+			break;
+		case OPT_NOISE_FLOOR:
+			if (!parse_number("noise-floor", optarg, v))
+				return false;
+			opt.analysis.noise_floor = (float)v;
+			break;
+		case OPT_ATTACK:
+			if (!parse_number("attack", optarg, v))
+				return false;
+			opt.analysis.attack = (float)v;
+			break;
+		case OPT_RELEASE:
+			if (!parse_number("release", optarg, v))
+				return false;
+			opt.analysis.release = (float)v;
+			break;
+		case OPT_A4:
+			if (!parse_number("a4", optarg, v))
+				return false;
+			opt.analysis.chroma_a4 = (float)v;
+			break;
+		case OPT_BUDGET:
+			if (!parse_number("budget", optarg, v, 0.0, 100.0))
+				return false;
+			opt.analysis.quality_budget = (float)(v / 100.0);
+			break;
+		case 'B':
+			opt.bench = true;
+			break;
+		case 'v':
+			g_log_level = LOG_DEBUG;
+			break;
+		case 'h':
+			usage(stdout);
+			exit(0);
+		default:
+			usage(stderr);
+			return false;
+		}
+	}
+
+	if (optind < argc)
+		opt.input = argv[optind++];
+	if (optind < argc) {
+		fprintf(stderr, "unexpected argument: %s\n", argv[optind]);
+		return false;
+	}
+	opt.analysis.clamp();
+	return true;
+}
+
+static bool open_input(PcmReader &reader, const DaemonOptions &opt)
+{
+	if (!reader.open(opt.input, opt.format, opt.block_frames)) {
+		blog(LOG_ERROR, "Cannot open input: %s", reader.error().c_str());
+		return false;
+	}
+	const PcmFormat &f = reader.format();
+	blog(LOG_INFO, "Input %s: %s, %u Hz, %u ch, %s%s", opt.input.c_str(), reader.is_wav() ? "WAV" : "raw PCM",
+	     f.sample_rate, f.channels, f.sample_format == PcmSampleFormat::S16 ? "s16" : "f32",
+	     f.planar ? ", planar" : "");
+	return true;
+}
+
+static int run_bench(PcmReader &reader, AnalysisPipeline &pipeline)
+{
+	// 所有資料流都當作有人訂閱，量測完整的分析成本
+	const float sample_rate = (float)reader.format().sample_rate;
+	AnalysisFrame frame;
+	BlockStats stats;
+	const uint64_t start = now_ns();
+
+	const float *mono = nullptr;
+	size_t frames;
+	while (!g_stop.load() && (frames = reader.read_block(mono)) > 0) {
+		const uint64_t t0 = now_ns();
+		pipeline.process(mono, frames, true, true, &frame);
+		stats.add(frames, now_ns() - t0);
+	}
+	if (!reader.error().empty())
+		blog(LOG_ERROR, "Read error: %s", reader.error().c_str());
+
+	const double wall = (double)(now_ns() - start) / 1e9;
+	const double audio = (double)stats.frames / sample_rate;
+	const double analysis = (double)stats.total_ns / 1e9;
+	const double mean_us = stats.blocks ? (double)stats.total_ns / (double)stats.blocks / 1e3 : 0.0;
+	const double budget_us = stats.blocks ? audio / (double)stats.blocks * 1e6 : 0.0;
+	printf("audio:    %.2f s in %llu blocks\n", audio, (unsigned long long)stats.blocks);
+	printf("wall:     %.3f s (including input)\n", wall);
+	printf("analysis: %.3f s, %.0fx realtime\n", analysis, analysis > 0.0 ? audio / analysis : 0.0);
+	printf("block:    mean %.1f us, max %.1f us, budget %.1f us\n", mean_us, (double)stats.max_ns / 1e3,
+	       budget_us);
+	printf("quality:  level %d, load %.2f%%\n", pipeline.quality(), pipeline.load() * 100.0f);
+	return stats.blocks ? 0 : 1;
+}
+
+static int run_server(PcmReader &reader, AnalysisPipeline &pipeline, const DaemonOptions &opt)
+{
+	// 與插件相同的分工：讀取 / 分析執行緒產生帶時間戳記的幀，發佈執行緒依延遲送出
+	// 先擋下訊號再建立執行緒，讓它們繼承；之後只在主執行緒解除，
+	// 讀取中的 poll 會在逾時後看到 g_stop
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+	FrameDelayLine delay_line;
+	delay_line.configure(256);
+	delay_line.set_delay(opt.delay_ms > 0 ? (uint64_t)opt.delay_ms * 1000000ULL : 0);
+
+	WebSocketServer server;
+	server.setBindAddress(opt.bind_address);
+	server.setClock(now_ns);
+	if (!opt.frontend.empty())
+		server.setAssetRoot(opt.frontend);
+	server.setHistory(opt.history_seconds, opt.history_bits);
+	if (!server.start(opt.port)) {
+		blog(LOG_ERROR, "Cannot listen on %s:%d", opt.bind_address.c_str(), (int)opt.port);
+		return 1;
+	}
+
+	std::atomic<bool> active{false};
+	std::atomic<bool> chroma_active{false};
+	std::atomic<bool> features_active{false};
+
+	// 約 60 FPS，相當於插件的 video tick
+	std::thread publisher([&]() {
+		AnalysisFrame frame;
+		bool published_silent = false;
+		int reported_quality = 0;
+		while (!g_stop.load()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(16));
+
+			const bool has_clients = server.hasSubscribers();
+			active.store(has_clients);
+			chroma_active.store(has_clients && server.wantsStream(WebSocketServer::STREAM_CHROMA));
+			features_active.store(has_clients && server.wantsStream(WebSocketServer::STREAM_FEATURES));
+			if (!has_clients) {
+				published_silent = false;
+				delay_line.clear();
+				continue;
+			}
+			const int quality = pipeline.quality();
+			if (quality != reported_quality) {
+				blog(LOG_INFO, "Analysis quality level %d -> %d (load %.1f%%)", reported_quality, quality,
+				     pipeline.load() * 100.0f);
+				reported_quality = quality;
+				server.setQuality(quality);
+			}
+			if (!delay_line.release(now_ns(), frame))
+				continue;
+			if (frame.silent && published_silent)
+				continue;
+			published_silent = frame.silent;
+
+			const uint64_t present_ns = frame.timestamp + delay_line.delay();
+			if (chroma_active.load())
+				server.setChroma(frame.chroma.data(), present_ns);
+			if (features_active.load())
+				server.setFeatures(frame.features.data(), present_ns);
+			server.setBars(frame.bars.data(), frame.band_count, present_ns);
+		}
+	});
+
+	pthread_sigmask(SIG_UNBLOCK, &signals, nullptr);
+
+	const bool realtime = opt.realtime < 0 ? reader.is_regular_file() : opt.realtime > 0;
+	const double sample_rate = (double)reader.format().sample_rate;
+	BlockStats stats;
+	uint64_t start = now_ns();
+	uint64_t paced_frames = 0;
+
+	const float *mono = nullptr;
+	while (!g_stop.load()) {
+		const size_t frames = reader.read_block(mono);
+		if (frames == 0) {
+			if (g_stop.load())
+				break;
+			if (!reader.error().empty())
+				blog(LOG_ERROR, "Read error: %s", reader.error().c_str());
+			if (!opt.loop || !reader.is_regular_file() || !open_input(reader, opt))
+				break;
+			start = now_ns();
+			paced_frames = 0;
+			continue;
+		}
+
+		// 檔案輸入依取樣率節流，讓畫面以正常速度播放
+		if (realtime) {
+			paced_frames += frames;
+			const uint64_t due = start + (uint64_t)((double)paced_frames / sample_rate * 1e9);
+			const uint64_t now = now_ns();
+			if (due > now)
+				std::this_thread::sleep_for(std::chrono::nanoseconds(due - now));
+		}
+
+		// 沒人在聽時照樣把輸入讀掉（避免上游阻塞），但不做任何 DSP
+		if (!active.load(std::memory_order_relaxed)) {
+			pipeline.request_reset();
+			continue;
+		}
+
+		const uint64_t t0 = now_ns();
+		AnalysisFrame *frame = delay_line.begin_push(t0);
+		if (pipeline.process(mono, frames, chroma_active.load(std::memory_order_relaxed),
+				     features_active.load(std::memory_order_relaxed), frame) &&
+		    frame)
+			delay_line.commit_push();
+		stats.add(frames, now_ns() - t0);
+	}
+
+	g_stop.store(true);
+	publisher.join();
+	server.stop();
+
+	if (stats.blocks) {
+		blog(LOG_INFO, "Analyzed %llu blocks, mean %.1f us, max %.1f us per block",
+		     (unsigned long long)stats.blocks, (double)stats.total_ns / (double)stats.blocks / 1e3,
+		     (double)stats.max_ns / 1e3);
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	DaemonOptions opt;
+	if (!parse_options(argc, argv, opt))
+		return 2;
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = handle_signal;
+	sigaction(SIGINT, &sa, nullptr);
+	sigaction(SIGTERM, &sa, nullptr);
+	signal(SIGPIPE, SIG_IGN);
+
+	PcmReader reader;
+	reader.set_stop_flag(&g_stop);
+	if (!open_input(reader, opt))
+		return g_stop.load() ? 0 : 1;
+
+	AnalysisPipeline pipeline;
+	pipeline.configure(opt.analysis, (float)reader.format().sample_rate);
+
+	if (opt.bench)
+		return run_bench(reader, pipeline);
+	return run_server(reader, pipeline, opt);
+}
@@ -2,7 +2,6 @@
 #include "websocket_server.hpp"
 
 #include <util/platform.h>
-#include <cmath>
 
 #define blog(level, msg, ...) blog(level, "audio-ws: " msg, ##__VA_ARGS__)
 
@@ -12,6 +11,19 @@ static const char *P_GAIN = "gain";
 static const char *P_NOISE_FLOOR = "noise_floor";
 static const char *P_ATTACK = "attack";
 static const char *P_RELEASE = "release";
+static const char *P_BAND_COUNT = "band_count";
+static const char *P_BAND_SCALE = "band_scale";
+static const char *P_BAND_MIN_FREQ = "band_min_freq";
+static const char *P_BAND_MAX_FREQ = "band_max_freq";
+static const char *P_BAND_EDGES = "band_edges";
+static const char *P_CHROMA_A4 = "chroma_a4";
+static const char *P_CHROMA_MIN_OCTAVE = "chroma_min_octave";
+static const char *P_CHROMA_MAX_OCTAVE = "chroma_max_octave";
+static const char *P_SYNC_AUTO = "sync_auto";
+static const char *P_SYNC_OFFSET = "sync_offset_ms";
+static const char *P_HISTORY_SECONDS = "history_seconds";
+static const char *P_HISTORY_BITS = "history_bits";
+static const char *P_QUALITY_BUDGET = "quality_budget";
 
 // === AudioWsSource implementation ===
 
@@ -19,17 +31,29 @@ AudioWsSource::AudioWsSource(obs_source_t *source)
 	: m_source(source)
 {
 	memset(&m_audio_info, 0, sizeof(m_audio_info));
-	if (obs_get_audio_info(&m_audio_info)) {
-		m_channels = get_audio_channels(m_audio_info.speakers);
-	} else {
-		m_channels = 0;
-	}
-	init_bands();
+	if (obs_get_audio_info(&m_audio_info))
+		m_channels.store(get_audio_channels(m_audio_info.speakers));
+	// 約 5 秒的 OBS 音訊區塊；延遲更長時生產端會自動拉大間隔
+	m_delay_line.configure(256);
+
+	signal_handler_t *sh = obs_get_signal_handler();
+	signal_handler_connect(sh, "source_create", &AudioWsSource::source_created, this);
+	signal_handler_connect(sh, "source_remove", &AudioWsSource::source_removed, this);
+	signal_handler_connect(sh, "source_destroy", &AudioWsSource::source_removed, this);
+	signal_handler_connect(sh, "source_rename", &AudioWsSource::source_renamed, this);
 }
 
 AudioWsSource::~AudioWsSource()
 {
-	release_audio_capture();
+	// 先斷開訊號，之後不會再有其他執行緒來綁定
+	signal_handler_t *sh = obs_get_signal_handler();
+	signal_handler_disconnect(sh, "source_create", &AudioWsSource::source_created, this);
+	signal_handler_disconnect(sh, "source_remove", &AudioWsSource::source_removed, this);
+	signal_handler_disconnect(sh, "source_destroy", &AudioWsSource::source_removed, this);
+	signal_handler_disconnect(sh, "source_rename", &AudioWsSource::source_renamed, this);
+
+	std::lock_guard<std::mutex> lock(m_capture_mutex);
+	release_audio_capture_locked();
 }
 
 void AudioWsSource::get_defaults(obs_data_t *settings)
@@ -39,6 +63,19 @@ void AudioWsSource::get_defaults(obs_data_t *settings)
 	obs_data_set_default_double(settings, P_NOISE_FLOOR, 0.0005);
 	obs_data_set_default_double(settings, P_ATTACK, 0.7);
 	obs_data_set_default_double(settings, P_RELEASE, 0.3);
+	obs_data_set_default_int(settings, P_BAND_COUNT, 12);
+	obs_data_set_default_string(settings, P_BAND_SCALE, "log");
+	obs_data_set_default_double(settings, P_BAND_MIN_FREQ, 45.0);
+	obs_data_set_default_double(settings, P_BAND_MAX_FREQ, 12500.0);
+	obs_data_set_default_string(settings, P_BAND_EDGES, "");
+	obs_data_set_default_double(settings, P_CHROMA_A4, 440.0);
+	obs_data_set_default_int(settings, P_CHROMA_MIN_OCTAVE, 2);
+	obs_data_set_default_int(settings, P_CHROMA_MAX_OCTAVE, 7);
+	obs_data_set_default_bool(settings, P_SYNC_AUTO, true);
+	obs_data_set_default_int(settings, P_SYNC_OFFSET, 0);
+	obs_data_set_default_int(settings, P_HISTORY_SECONDS, 30);
+	obs_data_set_default_int(settings, P_HISTORY_BITS, 8);
+	obs_data_set_default_int(settings, P_QUALITY_BUDGET, 10);
 }
 
 obs_properties_t *AudioWsSource::get_properties(void *data)
@@ -56,6 +93,45 @@ obs_properties_t *AudioWsSource::get_properties(void *data)
 	obs_properties_add_float_slider(props, P_ATTACK, "Attack (0-1)", 0.0, 1.0, 0.05);
 	obs_properties_add_float_slider(props, P_RELEASE, "Release (0-1)", 0.0, 1.0, 0.05);
 
+	obs_properties_add_int_slider(props, P_BAND_COUNT, "Band Count", 1, (int)BandLayout::MAX_BANDS, 1);
+	obs_property_t *scale = obs_properties_add_list(props, P_BAND_SCALE, "Frequency Scale",
+						      OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+	obs_property_list_add_string(scale, "Logarithmic", "log");
+	obs_property_list_add_string(scale, "Mel", "mel");
+	obs_property_list_add_string(scale, "Bark", "bark");
+	obs_property_list_add_string(scale, "Custom Edges", "custom");
+	obs_properties_add_float(props, P_BAND_MIN_FREQ, "Lowest Frequency (Hz)", 10.0, 2000.0, 1.0);
+	obs_properties_add_float(props, P_BAND_MAX_FREQ, "Highest Frequency (Hz)", 1000.0, 24000.0, 10.0);
+	// 自訂邊界：頻段數 = 邊界數 - 1，會忽略 Band Count
+	obs_properties_add_text(props, P_BAND_EDGES, "Custom Edges (Hz, comma separated)", OBS_TEXT_DEFAULT);
+
+	// 畫面同步：幀在「音訊時間 + 偏移」才送出
+	obs_properties_add_bool(props, P_SYNC_AUTO, "Follow Source Sync Offset");
+	obs_property_t *offset = obs_properties_add_int_slider(props, P_SYNC_OFFSET, "Extra Visual Delay (ms)",
+								-500, 2000, 10);
+	obs_property_set_long_description(offset,
+					  "Added on top of the source's sync offset, e.g. to compensate browser source latency. "
+					  "Negative values only cancel part of the sync offset: the total delay never goes below 0.");
+
+	// 音級（chroma）資料流：只有用戶端訂閱時才計算
+	obs_properties_add_float(props, P_CHROMA_A4, "Chroma Tuning (A4, Hz)", 400.0, 480.0, 0.1);
+	obs_properties_add_int(props, P_CHROMA_MIN_OCTAVE, "Chroma Lowest Octave", 0, 9, 1);
+	obs_properties_add_int(props, P_CHROMA_MAX_OCTAVE, "Chroma Highest Octave", 0, 9, 1);
+
+	// 伺服器端保留的頻譜歷史，新連線的用戶端會先收到一份 backfill
+	obs_properties_add_int_slider(props, P_HISTORY_SECONDS, "History Length (s, 0 = off)", 0, 120, 1);
+	obs_property_t *bits = obs_properties_add_list(props, P_HISTORY_BITS, "History Precision",
+						     OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(bits, "8-bit", 8);
+	obs_property_list_add_int(bits, "16-bit", 16);
+
+	// 分析耗時超過預算時自動降低視窗 / 頻段 / 更新頻率，負載降下來後再慢慢升回去
+	obs_property_t *budget = obs_properties_add_int_slider(props, P_QUALITY_BUDGET,
+								"CPU Budget (% of real time, 0 = fixed quality)", 0, 50, 1);
+	obs_property_set_long_description(budget,
+					  "When analysis takes longer than this share of the audio it covers, "
+					  "the spectrum resolution and update rate are lowered until it fits.");
+
 	// 枚舉所有帶音訊的來源
 	obs_enum_sources([](void *param, obs_source_t *src) {
 		obs_property_t *list = (obs_property_t *)param;
@@ -88,69 +164,128 @@ void AudioWsSource::update(obs_data_t *settings)
 		src_name = P_OUTPUT_BUS;
 	}
 
-	m_use_output_bus = (strcmp(src_name, P_OUTPUT_BUS) == 0);
-	m_audio_source_name = m_use_output_bus ? std::string() : std::string(src_name);
-
-	double gain = obs_data_get_double(settings, P_GAIN);
-	double noise_floor = obs_data_get_double(settings, P_NOISE_FLOOR);
-	double attack = obs_data_get_double(settings, P_ATTACK);
-	double release = obs_data_get_double(settings, P_RELEASE);
-
-	if (gain < 0.1)
-		gain = 0.1;
-	if (gain > 16.0)
-		gain = 16.0;
-	if (noise_floor < 0.0)
-		noise_floor = 0.0;
-	if (noise_floor > 0.1)
-		noise_floor = 0.1;
-	if (attack < 0.0)
-		attack = 0.0;
-	if (attack > 1.0)
-		attack = 1.0;
-	if (release < 0.0)
-		release = 0.0;
-	if (release > 1.0)
-		release = 1.0;
-
+	const bool use_output_bus = (strcmp(src_name, P_OUTPUT_BUS) == 0);
+	const std::string audio_source_name = use_output_bus ? std::string() : std::string(src_name);
+
+	AnalysisSettings analysis;
+	analysis.gain = (float)obs_data_get_double(settings, P_GAIN);
+	analysis.noise_floor = (float)obs_data_get_double(settings, P_NOISE_FLOOR);
+	analysis.attack = (float)obs_data_get_double(settings, P_ATTACK);
+	analysis.release = (float)obs_data_get_double(settings, P_RELEASE);
+	long long band_count = obs_data_get_int(settings, P_BAND_COUNT);
+	analysis.band_count = band_count > 0 ? (size_t)band_count : 1;
+	analysis.band_scale = BandLayout::parse_scale(obs_data_get_string(settings, P_BAND_SCALE));
+	analysis.band_min_freq = (float)obs_data_get_double(settings, P_BAND_MIN_FREQ);
+	analysis.band_max_freq = (float)obs_data_get_double(settings, P_BAND_MAX_FREQ);
+	analysis.band_edges = BandLayout::parse_edges(obs_data_get_string(settings, P_BAND_EDGES));
+	analysis.chroma_a4 = (float)obs_data_get_double(settings, P_CHROMA_A4);
+	analysis.chroma_min_octave = (int)obs_data_get_int(settings, P_CHROMA_MIN_OCTAVE);
+	analysis.chroma_max_octave = (int)obs_data_get_int(settings, P_CHROMA_MAX_OCTAVE);
+	analysis.quality_budget = (float)obs_data_get_int(settings, P_QUALITY_BUDGET) / 100.0f;
+	analysis.clamp();
+
+	// 取樣率可能在 OBS 設定中被改過，每次都重新讀取。
+	// 音訊執行緒只讀 m_channels（atomic），m_audio_info 則和擷取狀態一起受 m_capture_mutex 保護
+	obs_audio_info info{};
+	const bool have_info = obs_get_audio_info(&info) && info.samples_per_sec;
+	uint32_t samples_per_sec;
 	{
-		std::lock_guard<std::mutex> lock(m_level_mutex);
-		m_gain = (float)gain;
-		m_noise_floor = (float)noise_floor;
-		m_attack = (float)attack;
-		m_release = (float)release;
+		std::lock_guard<std::mutex> lock(m_capture_mutex);
+		if (have_info) {
+			m_audio_info = info;
+			m_channels.store(get_audio_channels(info.speakers));
+		}
+		samples_per_sec = m_audio_info.samples_per_sec;
 	}
+	const float sr = (float)(samples_per_sec ? samples_per_sec : 48000);
+	// 只重建有變動的係數，音訊執行緒下一個區塊就會拿到新參數
+	m_pipeline.configure(analysis, sr);
 
-	release_audio_capture();
-	recapture_audio();
+	m_sync_auto.store(obs_data_get_bool(settings, P_SYNC_AUTO));
+	m_manual_delay_ns.store(obs_data_get_int(settings, P_SYNC_OFFSET) * 1000000LL);
+
+	WebSocketServer *server = GetGlobalWebSocketServer();
+	if (server)
+		server->setHistory((double)obs_data_get_int(settings, P_HISTORY_SECONDS),
+				   (int)obs_data_get_int(settings, P_HISTORY_BITS));
+
+	// 拖動滑桿時 update 每秒會被呼叫好幾十次：只有擷取目標真的改變才重新掛 callback，
+	// 其餘參數都在不中斷音訊的情況下替換
+	std::lock_guard<std::mutex> lock(m_capture_mutex);
+	if (!m_configured || use_output_bus != m_use_output_bus || audio_source_name != m_audio_source_name) {
+		m_use_output_bus = use_output_bus;
+		m_audio_source_name = audio_source_name;
+		m_configured = true;
+		recapture_audio_locked();
+	}
 }
 
-void AudioWsSource::tick(float seconds)
+void AudioWsSource::tick()
 {
-	if (!m_capture_ok) {
-		m_retry_accum += seconds;
-		if (m_retry_accum >= 1.0f) {
-			m_retry_accum = 0.0f;
-			recapture_audio();
-		}
-	} else {
-		m_retry_accum = 0.0f;
+	// 來源的綁定由 OBS 訊號驅動；輸出總線沒有訊號可等，連接失敗時在這裡重試
+	retry_output_bus();
+
+	// 沒有任何訂閱者時，音訊回呼直接返回，也不必推送
+	WebSocketServer *server = GetGlobalWebSocketServer();
+	bool active = server && server->hasSubscribers();
+	m_active.store(active);
+	m_chroma_active.store(active && server->wantsStream(WebSocketServer::STREAM_CHROMA));
+	m_features_active.store(active && server->wantsStream(WebSocketServer::STREAM_FEATURES));
+	if (!active) {
+		m_published_silent = false;
+		m_delay_line.clear();
+		return;
+	}
+
+	// 品質等級由音訊執行緒調整，這裡只負責記錄與轉告用戶端
+	const int quality = m_pipeline.quality();
+	if (quality != m_reported_quality) {
+		blog(LOG_INFO, "analysis quality level %d -> %d (load %.1f%%)", m_reported_quality, quality,
+		     m_pipeline.load() * 100.0f);
+		m_reported_quality = quality;
+		server->setQuality(quality);
 	}
 	update_websocket();
 }
 
-void AudioWsSource::recapture_audio()
+void AudioWsSource::retry_output_bus()
+{
+	// 每秒最多重試一次，平常只比較一次時間，不上鎖
+	const uint64_t now = os_gettime_ns();
+	if (now < m_next_bus_retry_ns)
+		return;
+	m_next_bus_retry_ns = now + 1000000000ULL;
+
+	std::lock_guard<std::mutex> lock(m_capture_mutex);
+	if (m_configured && m_use_output_bus && !m_output_bus_captured)
+		recapture_audio_locked();
+}
+
+uint64_t AudioWsSource::current_delay()
+{
+	// 擷取回呼拿到的是尚未套用同步偏移的時間戳記，這裡補上來源的偏移；
+	// 輸出總線的時間戳記已是混音後的時間軸，不必再加。
+	int64_t delay = m_manual_delay_ns.load();
+	std::lock_guard<std::mutex> lock(m_capture_mutex);
+	if (m_sync_auto.load() && !m_use_output_bus && m_audio_source) {
+		obs_source_t *src = obs_weak_source_get_source(m_audio_source);
+		if (src) {
+			delay += obs_source_get_sync_offset(src);
+			obs_source_release(src);
+		}
+	}
+	return delay > 0 ? (uint64_t)delay : 0;
+}
+
+void AudioWsSource::recapture_audio_locked()
 {
-	release_audio_capture();
+	release_audio_capture_locked();
 
 	if (m_use_output_bus) {
 		// 捕獲整個輸出總線
 		audio_t *audio = obs_get_audio();
 		if (!audio)
-		{
-			m_capture_ok = false;
 			return;
-		}
 
 		audio_convert_info cvt = {};
 		cvt.format = AUDIO_FORMAT_FLOAT_PLANAR;
@@ -158,28 +293,32 @@ void AudioWsSource::recapture_audio()
 		cvt.speakers = m_audio_info.speakers;
 
 		m_output_bus_captured = audio_output_connect(audio, 0, &cvt, &AudioWsSource::capture_output_bus, this);
-		m_capture_ok = m_output_bus_captured;
+		if (!m_output_bus_captured && !m_output_bus_failed)
+			blog(LOG_WARNING, "%s", "Failed to connect to the output bus, retrying every second");
+		else if (m_output_bus_captured && m_output_bus_failed)
+			blog(LOG_INFO, "%s", "Connected to the output bus");
+		m_output_bus_failed = !m_output_bus_captured;
 	} else {
-		// 捕獲特定來源
+		m_output_bus_failed = false;
+		// 捕獲特定來源；還不存在時（例如場景集合載入順序較前）等 source_create 訊號再綁定
 		if (m_audio_source_name.empty())
-		{
-			m_capture_ok = false;
 			return;
-		}
 		obs_source_t *src = obs_get_source_by_name(m_audio_source_name.c_str());
 		if (!src)
-		{
-			m_capture_ok = false;
 			return;
-		}
-		obs_source_add_audio_capture_callback(src, &AudioWsSource::capture_audio, this);
-		m_audio_source = obs_source_get_weak_source(src);
+		bind_source_locked(src);
 		obs_source_release(src);
-		m_capture_ok = true;
 	}
 }
 
-void AudioWsSource::release_audio_capture()
+void AudioWsSource::bind_source_locked(obs_source_t *src)
+{
+	obs_source_add_audio_capture_callback(src, &AudioWsSource::capture_audio, this);
+	m_audio_source = obs_source_get_weak_source(src);
+	blog(LOG_INFO, "Capturing audio from '%s'", obs_source_get_name(src));
+}
+
+void AudioWsSource::release_audio_capture_locked()
 {
 	if (m_audio_source) {
 		obs_source_t *src = obs_weak_source_get_source(m_audio_source);
@@ -195,7 +334,63 @@ void AudioWsSource::release_audio_capture()
 		m_output_bus_captured = false;
 		audio_output_disconnect(obs_get_audio(), 0, &AudioWsSource::capture_output_bus, this);
 	}
-	m_capture_ok = false;
+}
+
+void AudioWsSource::source_created(void *data, calldata_t *cd)
+{
+	AudioWsSource *self = static_cast<AudioWsSource *>(data);
+	obs_source_t *src = (obs_source_t *)calldata_ptr(cd, "source");
+	if (!src || src == self->m_source)
+		return;
+	const char *name = obs_source_get_name(src);
+
+	std::lock_guard<std::mutex> lock(self->m_capture_mutex);
+	if (self->m_use_output_bus || self->m_audio_source || !name || self->m_audio_source_name != name)
+		return;
+	self->bind_source_locked(src);
+}
+
+void AudioWsSource::source_removed(void *data, calldata_t *cd)
+{
+	AudioWsSource *self = static_cast<AudioWsSource *>(data);
+	obs_source_t *src = (obs_source_t *)calldata_ptr(cd, "source");
+	if (!src)
+		return;
+
+	std::lock_guard<std::mutex> lock(self->m_capture_mutex);
+	if (!self->m_audio_source || !obs_weak_source_references_source(self->m_audio_source, src))
+		return;
+	// 保留目標名稱：同名來源重新加入時會由 source_create 重新綁定
+	obs_source_remove_audio_capture_callback(src, &AudioWsSource::capture_audio, self);
+	obs_weak_source_release(self->m_audio_source);
+	self->m_audio_source = nullptr;
+	blog(LOG_INFO, "Audio source '%s' went away, waiting for it to return", self->m_audio_source_name.c_str());
+}
+
+void AudioWsSource::source_renamed(void *data, calldata_t *cd)
+{
+	AudioWsSource *self = static_cast<AudioWsSource *>(data);
+	obs_source_t *src = (obs_source_t *)calldata_ptr(cd, "source");
+	const char *new_name = calldata_string(cd, "new_name");
+	if (!src || !new_name || src == self->m_source)
+		return;
+
+	std::lock_guard<std::mutex> lock(self->m_capture_mutex);
+	if (self->m_use_output_bus)
+		return;
+
+	if (self->m_audio_source && obs_weak_source_references_source(self->m_audio_source, src)) {
+		// 跟著改名，並寫回設定，下次 update 不會誤判為換了來源
+		self->m_audio_source_name = new_name;
+		obs_data_t *settings = obs_source_get_settings(self->m_source);
+		if (settings) {
+			obs_data_set_string(settings, P_AUDIO_SRC, new_name);
+			obs_data_release(settings);
+		}
+	} else if (!self->m_audio_source && self->m_audio_source_name == new_name) {
+		// 其他來源改成了目標名稱
+		self->bind_source_locked(src);
+	}
 }
 
 void AudioWsSource::capture_audio(void *param, obs_source_t *source, const audio_data *audio, bool muted)
@@ -217,119 +412,53 @@ void AudioWsSource::process_audio(const audio_data *audio, bool muted)
 	if (!audio || muted)
 		return;
 
-	const size_t frames = (size_t)audio->frames;
-	if (frames == 0)
+	// 閒置：沒人在聽就不做任何 DSP，只記得恢復時要重置狀態
+	if (!m_active.load(std::memory_order_relaxed)) {
+		m_pipeline.request_reset();
 		return;
+	}
 
 	// 取得單聲道資料（取第一個有資料的聲道）
 	const float *mono = nullptr;
-	size_t planes = m_channels ? m_channels : MAX_AV_PLANES;
+	const size_t channels = m_channels.load(std::memory_order_relaxed);
+	size_t planes = channels ? channels : MAX_AV_PLANES;
 	for (size_t ch = 0; ch < planes; ++ch) {
 		if (audio->data[ch]) {
 			mono = (const float *)audio->data[ch];
 			break;
 		}
 	}
-	if (!mono)
-		return;
-
-	// 全局 RMS（可用於附加用途）
-	float sum_sq = 0.0f;
-	for (size_t i = 0; i < frames; ++i) {
-		float v = mono[i];
-		sum_sq += v * v;
-	}
-	float rms = frames ? sqrtf(sum_sq / (float)frames) : 0.0f;
-
-	// 12 頻段能量（簡化 Goertzel）
-	float band_values[12] = {};
-	for (size_t b = 0; b < 12; ++b) {
-		float coeff = m_band_coef[b];
-		float s_prev = 0.0f;
-		float s_prev2 = 0.0f;
-		for (size_t n = 0; n < frames; ++n) {
-			float s = mono[n] + coeff * s_prev - s_prev2;
-			s_prev2 = s_prev;
-			s_prev = s;
-		}
-		float power = s_prev2 * s_prev2 + s_prev * s_prev - coeff * s_prev * s_prev2;
-		if (power < 0.0f)
-			power = 0.0f;
-		band_values[b] = power / (float)frames;
-	}
-
-	std::lock_guard<std::mutex> lock(m_level_mutex);
-
-	// 更新全局 m_level（保留原有行為）
-	{
-		float level_lin = rms * m_gain;
-		if (level_lin < m_noise_floor)
-			level_lin = 0.0f;
-		if (level_lin > 1.0f)
-			level_lin = 1.0f;
-		float level = std::sqrt(level_lin);
-		if (level > m_level)
-			m_level = m_level * (1.0f - m_attack) + level * m_attack;
-		else
-			m_level = m_level * (1.0f - m_release) + level * m_release;
-	}
-
-	// 依照頻段能量更新每條 bar 的值
-	for (size_t b = 0; b < 12; ++b) {
-		float v = band_values[b] * m_gain;
-		if (v < m_noise_floor)
-			v = 0.0f;
-		if (v > 1.0f)
-			v = 1.0f;
-		v = std::sqrt(v);
-		float &cur = m_bar_levels[b];
-		if (v > cur)
-			cur = cur * (1.0f - m_attack) + v * m_attack;
-		else
-			cur = cur * (1.0f - m_release) + v * m_release;
-	}
-}
-
-void AudioWsSource::init_bands()
-{
-	// 以常見 12-band EQ 的中心頻率為參考，採用對數分佈
-	// 單位: Hz
-	const float default_freqs[12] = {
-		60.0f, 100.0f, 160.0f, 250.0f,
-		400.0f, 630.0f, 1000.0f, 1600.0f,
-		2500.0f, 4000.0f, 6300.0f, 10000.0f
-	};
 
-	float sr = (float)(m_audio_info.samples_per_sec ? m_audio_info.samples_per_sec : 48000);
-	if (sr <= 0.0f)
-		sr = 48000.0f;
-
-	for (size_t i = 0; i < 12; ++i) {
-		float f = default_freqs[i];
-		// 確保不超過 Nyquist 頻率
-		float nyquist = sr * 0.5f;
-		if (f > nyquist)
-			f = nyquist;
-		m_band_freqs[i] = f;
-		// Goertzel 係數: 2*cos(2*pi*f/Fs)
-		const float pi = 3.14159265358979323846f;
-		float omega = 2.0f * pi * f / sr;
-		m_band_coef[i] = 2.0f * cosf(omega);
-	}
+	// 以音訊時間戳記標記這一幀，交給 tick 依延遲送出；佇列滿時照樣分析，只是不送
+	AnalysisFrame *frame = m_delay_line.begin_push(audio->timestamp);
+	const bool chroma = m_chroma_active.load(std::memory_order_relaxed);
+	const bool features = m_features_active.load(std::memory_order_relaxed);
+	if (m_pipeline.process(mono, (size_t)audio->frames, chroma, features, frame) && frame)
+		m_delay_line.commit_push();
 }
 
 void AudioWsSource::update_websocket()
 {
-	std::array<float, 12> bars{};
-	{
-		std::lock_guard<std::mutex> lock(m_level_mutex);
-		for (size_t i = 0; i < bars.size(); ++i)
-			bars[i] = m_bar_levels[i];
-	}
+	m_delay_line.set_delay(current_delay());
+	AnalysisFrame &frame = m_release_frame;
+	if (!m_delay_line.release(os_gettime_ns(), frame))
+		return;
+
+	// 靜音期間 bar 全為 0，送過一次即可
+	if (frame.silent && m_published_silent)
+		return;
+	m_published_silent = frame.silent;
 
 	WebSocketServer *server = GetGlobalWebSocketServer();
-	if (server)
-		server->setBars(bars);
+	if (!server)
+		return;
+	// 送出的時間為「應該被看到」的時間：音訊時間 + 延遲
+	const uint64_t present_ns = frame.timestamp + m_delay_line.delay();
+	if (m_chroma_active.load())
+		server->setChroma(frame.chroma.data(), present_ns);
+	if (m_features_active.load())
+		server->setFeatures(frame.features.data(), present_ns);
+	server->setBars(frame.bars.data(), frame.band_count, present_ns);
 }
 
 // === obs_source_info ===
@@ -360,7 +489,8 @@ static void init_audio_ws_source_info()
 	audio_ws_source_info.video_render = nullptr; // 不渲染畫面
 	audio_ws_source_info.audio_render = nullptr;
 	audio_ws_source_info.video_tick = [](void *data, float seconds) {
-		static_cast<AudioWsSource *>(data)->tick(seconds);
+		UNUSED_PARAMETER(seconds);
+		static_cast<AudioWsSource *>(data)->tick();
 	};
 }
 
@@ -2,9 +2,12 @@
 
 #include <obs-module.h>
 #include <string>
-#include <array>
+#include <atomic>
 #include <mutex>
 
+#include "analysis_pipeline.hpp"
+#include "frame_delay_line.hpp"
+
 class WebSocketServer;
 
 class AudioWsSource {
@@ -13,7 +16,7 @@ public:
 	~AudioWsSource();
 
 	void update(obs_data_t *settings);
-	void tick(float seconds);
+	void tick();
 
 	static void get_defaults(obs_data_t *settings);
 	static obs_properties_t *get_properties(void *data);
@@ -26,32 +29,49 @@ public:
 
 private:
 	obs_source_t *m_source = nullptr;
-	obs_weak_source_t *m_audio_source = nullptr;
+
+	// 擷取目標：update（UI 執行緒）、OBS 全域訊號（建立來源的執行緒）與 tick 都會讀寫，受 m_capture_mutex 保護
+	std::mutex m_capture_mutex;
+	obs_weak_source_t *m_audio_source = nullptr; // 已掛上 callback 的來源，目標尚未出現時為 nullptr
 	std::string m_audio_source_name;
 	bool m_use_output_bus = false;
+	bool m_configured = false; // 第一次 update 一定要擷取
 	bool m_output_bus_captured = false;
+	bool m_output_bus_failed = false; // 連接失敗，由 tick 重試；只在第一次失敗時警告
+
+	obs_audio_info m_audio_info{}; // 需持有 m_capture_mutex（update 改寫，擷取輸出總線時讀取）
+	std::atomic<size_t> m_channels{0}; // 音訊執行緒讀取，update 時可能改變
+
+	// 分析本身與 OBS 無關，和獨立 daemon 共用
+	AnalysisPipeline m_pipeline;
+	std::atomic<bool> m_chroma_active{false}; // 有用戶端訂閱 chroma 時才計算，由 tick 更新
+	std::atomic<bool> m_features_active{false}; // 同上，特徵描述
 
-	obs_audio_info m_audio_info{};
-	size_t m_channels = 0;
+	// 音訊執行緒產生的幀依時間戳記延遲到 tick 才送出，對齊同步偏移與瀏覽器延遲
+	FrameDelayLine m_delay_line;
+	AnalysisFrame m_release_frame; // 僅 tick 使用
+	std::atomic<int64_t> m_manual_delay_ns{0};
+	std::atomic<bool> m_sync_auto{true};
 
-	float m_level = 0.0f; // 0..1 之間的音量估計
-	std::mutex m_level_mutex;
-	bool m_capture_ok = false;
-	float m_retry_accum = 0.0f;
+	// 閒置 / 靜音狀態
+	std::atomic<bool> m_active{false}; // 有 WebSocket 訂閱者時才分析，由 tick 更新
+	bool m_published_silent = false;   // 僅 tick 使用：歸零後的 frame 是否已送出
+	int m_reported_quality = 0;        // 僅 tick 使用：上次記錄 / 送出的品質等級
+	uint64_t m_next_bus_retry_ns = 0;  // 僅 tick 使用：下次重試連接輸出總線的時間
 
-	float m_gain = 3.0f;
-	float m_noise_floor = 0.0005f;
-	float m_attack = 0.7f;
-	float m_release = 0.3f;
-	std::array<float, 12> m_bar_levels{};
-	std::array<float, 12> m_band_freqs{};
-	std::array<float, 12> m_band_coef{};
+	uint64_t current_delay();
+	void retry_output_bus();
+	// 以下 *_locked 需持有 m_capture_mutex
+	void recapture_audio_locked();
+	void release_audio_capture_locked();
+	void bind_source_locked(obs_source_t *src);
 
-	void recapture_audio();
-	void release_audio_capture();
+	// OBS 全域訊號：目標來源出現時立即綁定、改名時跟著改、移除時解除
+	static void source_created(void *data, calldata_t *cd);
+	static void source_removed(void *data, calldata_t *cd);
+	static void source_renamed(void *data, calldata_t *cd);
 	void process_audio(const audio_data *audio, bool muted);
 	void update_websocket();
-	void init_bands();
 };
 
 extern obs_source_info audio_ws_source_info;
@@ -0,0 +1,197 @@
+#include "band_layout.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+// 頻率 <-> 刻度座標的轉換，頻段邊界在刻度座標上等距分佈
+static float to_scale(BandScale scale, float f)
+{
+	switch (scale) {
+	case BandScale::Mel:
+		return 2595.0f * log10f(1.0f + f / 700.0f);
+	case BandScale::Bark:
+		// Traunmüller (1990)
+		return 26.81f * f / (1960.0f + f) - 0.53f;
+	case BandScale::Log:
+	case BandScale::Custom:
+	default:
+		return logf(f);
+	}
+}
+
+static float from_scale(BandScale scale, float z)
+{
+	switch (scale) {
+	case BandScale::Mel:
+		return 700.0f * (powf(10.0f, z / 2595.0f) - 1.0f);
+	case BandScale::Bark:
+		return 1960.0f * (z + 0.53f) / (26.28f - z);
+	case BandScale::Log:
+	case BandScale::Custom:
+	default:
+		return expf(z);
+	}
+}
+
+BandScale BandLayout::parse_scale(const char *name)
+{
+	if (!name)
+		return BandScale::Log;
+	if (strcmp(name, "mel") == 0)
+		return BandScale::Mel;
+	if (strcmp(name, "bark") == 0)
+		return BandScale::Bark;
+	if (strcmp(name, "custom") == 0)
+		return BandScale::Custom;
+	return BandScale::Log;
+}
+
+std::vector<float> BandLayout::parse_edges(const char *text)
+{
+	std::vector<float> edges;
+	if (!text)
+		return edges;
+	const char *p = text;
+	while (*p) {
+		char *end = nullptr;
+		float v = strtof(p, &end);
+		if (end == p) {
+			++p; // 略過分隔符號
+			continue;
+		}
+		if (std::isfinite(v) && v > 0.0f)
+			edges.push_back(v);
+		p = end;
+	}
+	return edges;
+}
+
+void BandLayout::build(size_t band_count, BandScale scale, float min_freq, float max_freq,
+		       const std::vector<float> &custom_edges, float sample_rate, size_t fft_size)
+{
+	if (sample_rate <= 0.0f)
+		sample_rate = 48000.0f;
+	const float nyquist = sample_rate * 0.5f;
+
+	// 先決定頻段邊界（Hz）
+	std::vector<float> edges;
+	if (scale == BandScale::Custom) {
+		edges = custom_edges;
+		std::sort(edges.begin(), edges.end());
+		edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+		while (!edges.empty() && edges.back() > nyquist)
+			edges.pop_back();
+		if (edges.size() > MAX_BANDS + 1)
+			edges.resize(MAX_BANDS + 1);
+		if (edges.size() < 2) {
+			edges.clear();
+			scale = BandScale::Log;
+		}
+	}
+	if (edges.empty()) {
+		if (band_count < 1)
+			band_count = 1;
+		if (band_count > MAX_BANDS)
+			band_count = MAX_BANDS;
+		if (min_freq < 1.0f)
+			min_freq = 1.0f;
+		if (max_freq > nyquist)
+			max_freq = nyquist;
+		if (max_freq <= min_freq)
+			max_freq = std::min(nyquist, min_freq * 2.0f);
+
+		const float z0 = to_scale(scale, min_freq);
+		const float z1 = to_scale(scale, max_freq);
+		edges.resize(band_count + 1);
+		for (size_t i = 0; i <= band_count; ++i)
+			edges[i] = from_scale(scale, z0 + (z1 - z0) * (float)i / (float)band_count);
+	}
+
+	build_from_edges(edges, sample_rate, fft_size, nyquist);
+}
+
+void BandLayout::build_from_edges(const std::vector<float> &edges, float sample_rate, size_t fft_size,
+				  float max_freq)
+{
+	if (sample_rate <= 0.0f)
+		sample_rate = 48000.0f;
+	if (fft_size < 2)
+		fft_size = 2;
+	m_sample_rate = sample_rate;
+	m_fft_size = fft_size;
+	m_edges = edges;
+	m_rows.clear();
+	m_weights.clear();
+	if (edges.size() < 2)
+		return;
+
+	const float bin_hz = sample_rate / (float)fft_size;
+	const size_t bins = fft_size / 2 + 1;
+
+	// 每個 bin 涵蓋 [(k - 0.5), (k + 0.5)] * bin_hz，權重 = 與頻段重疊的寬度，最後正規化為加權平均
+	const size_t count = edges.size() - 1;
+	m_rows.reserve(count);
+	for (size_t b = 0; b < count; ++b) {
+		const float lo = edges[b];
+		const float hi = std::min(edges[b + 1], max_freq);
+		if (lo >= hi) {
+			// 完全在可用範圍之外：沒有任何 bin，apply() 輸出 0
+			m_rows.push_back({0, (uint32_t)m_weights.size(), 0});
+			continue;
+		}
+
+		size_t first = (size_t)std::max(0.0f, floorf(lo / bin_hz + 0.5f));
+		size_t last = (size_t)std::max(0.0f, floorf(hi / bin_hz + 0.5f));
+		if (first >= bins)
+			first = bins - 1;
+		if (last >= bins)
+			last = bins - 1;
+
+		Row row;
+		row.first_bin = (uint32_t)first;
+		row.offset = (uint32_t)m_weights.size();
+
+		float total = 0.0f;
+		for (size_t k = first; k <= last; ++k) {
+			const float bin_lo = ((float)k - 0.5f) * bin_hz;
+			const float bin_hi = ((float)k + 0.5f) * bin_hz;
+			float w = std::min(hi, bin_hi) - std::max(lo, bin_lo);
+			if (w < 0.0f)
+				w = 0.0f;
+			m_weights.push_back(w);
+			total += w;
+		}
+		row.count = (uint32_t)(last - first + 1);
+
+		if (total > 0.0f) {
+			// 被 max_freq 截掉的部分視為 0：仍以原本的寬度平均，bar 的刻度與完整頻段一致
+			const float coverage = (hi - lo) / (edges[b + 1] - lo);
+			const float scale = coverage / total;
+			for (size_t i = row.offset; i < m_weights.size(); ++i)
+				m_weights[i] *= scale;
+		} else {
+			// 頻段比 bin 還窄且剛好落在邊界上：直接取最近的 bin
+			m_weights.resize(row.offset);
+			m_weights.push_back(1.0f);
+			row.count = 1;
+		}
+		m_rows.push_back(row);
+	}
+	m_weights.shrink_to_fit();
+}
+
+void BandLayout::apply(const float *power, float *out) const
+{
+	const float *weights = m_weights.data();
+	for (size_t b = 0; b < m_rows.size(); ++b) {
+		const Row &row = m_rows[b];
+		const float *p = power + row.first_bin;
+		const float *w = weights + row.offset;
+		float acc = 0.0f;
+		for (uint32_t i = 0; i < row.count; ++i)
+			acc += p[i] * w[i];
+		out[b] = acc;
+	}
+}
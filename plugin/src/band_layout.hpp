@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 頻段配置：把 FFT 功率譜折算成任意數量的頻段。
+// 權重在 build() 時一次算好，存成緊湊的稀疏矩陣（每個頻段只記錄一段連續 bin），
+// apply() 每幀只做一次掃描，不配置記憶體。
+
+enum class BandScale {
+	Log,
+	Mel,
+	Bark,
+	Custom,
+};
+
+class BandLayout {
+public:
+	static constexpr size_t MAX_BANDS = 256;
+
+	// custom_edges 只在 BandScale::Custom 時使用（單位 Hz，頻段數 = 邊界數 - 1）。
+	// 自訂邊界不足兩個時退回對數分佈。
+	void build(size_t band_count, BandScale scale, float min_freq, float max_freq,
+		   const std::vector<float> &custom_edges, float sample_rate, size_t fft_size);
+
+	// 以現成的邊界（Hz，遞增）建立，不排序也不刪減頻段，用來在較低取樣率 / 較短視窗下
+	// 重現同一組頻段。max_freq 以上的部分不計入，整個在其上方的頻段固定輸出 0
+	void build_from_edges(const std::vector<float> &edges, float sample_rate, size_t fft_size,
+			      float max_freq);
+
+	size_t band_count() const { return m_rows.size(); }
+	// 實際使用的頻段邊界，數量為 band_count() + 1
+	const std::vector<float> &edges() const { return m_edges; }
+	size_t fft_size() const { return m_fft_size; }
+	float sample_rate() const { return m_sample_rate; }
+
+	// power 長度需為 fft_size / 2 + 1，out 長度需為 band_count()
+	void apply(const float *power, float *out) const;
+
+	static BandScale parse_scale(const char *name);
+	// 解析以逗號 / 空白分隔的頻率列表，例如 "40, 80, 160, 320"
+	static std::vector<float> parse_edges(const char *text);
+
+private:
+	struct Row {
+		uint32_t first_bin; // 第一個有權重的 bin
+		uint32_t offset;    // 在 m_weights 中的起點
+		uint32_t count;     // 連續 bin 數
+	};
+
+	std::vector<Row> m_rows;
+	std::vector<float> m_weights;
+	std::vector<float> m_edges;
+	size_t m_fft_size = 0;
+	float m_sample_rate = 0.0f;
+};
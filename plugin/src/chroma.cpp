@@ -0,0 +1,69 @@
+#include "chroma.hpp"
+
+#include <cmath>
+
+void ChromaKernel::build(float sample_rate, size_t fft_size, float a4_hz, int min_octave, int max_octave)
+{
+	m_entries.clear();
+	m_fft_size = fft_size;
+	if (sample_rate <= 0.0f || fft_size < 2)
+		return;
+	if (a4_hz <= 0.0f)
+		a4_hz = 440.0f;
+	if (max_octave < min_octave)
+		max_octave = min_octave;
+
+	// MIDI 音高：p = 69 + 12 * log2(f / A4)，C(n) = 12 * (n + 1)
+	const float p_lo = 12.0f * (float)(min_octave + 1) - 0.5f;
+	const float p_hi = 12.0f * (float)(max_octave + 2) - 0.5f;
+	const float f_lo = a4_hz * powf(2.0f, (p_lo - 69.0f) / 12.0f);
+	const float f_hi = a4_hz * powf(2.0f, (p_hi - 69.0f) / 12.0f);
+
+	const float bin_hz = sample_rate / (float)fft_size;
+	const size_t bins = fft_size / 2 + 1;
+	size_t first = (size_t)ceilf(f_lo / bin_hz);
+	size_t last = (size_t)floorf(f_hi / bin_hz);
+	if (first < 1)
+		first = 1;
+	if (last >= bins)
+		last = bins - 1;
+
+	const float semitone_ratio = powf(2.0f, 1.0f / 12.0f) - 1.0f;
+	for (size_t k = first; k <= last; ++k) {
+		const float f = (float)k * bin_hz;
+		const float p = 69.0f + 12.0f * log2f(f / a4_hz);
+
+		// 低頻時一個 bin 會跨好幾個半音，按比例降低權重，避免低音把所有音級抹平
+		float resolution = f * semitone_ratio / bin_hz;
+		if (resolution > 1.0f)
+			resolution = 1.0f;
+
+		// 線性分攤到最近的兩個半音
+		const float base = floorf(p);
+		const float frac = p - base;
+		const int pc0 = ((int)base % 12 + 12) % 12;
+		const int pc1 = (pc0 + 1) % 12;
+		if (frac < 1.0f)
+			m_entries.push_back({(uint32_t)k, (uint32_t)pc0, (1.0f - frac) * resolution});
+		if (frac > 0.0f)
+			m_entries.push_back({(uint32_t)k, (uint32_t)pc1, frac * resolution});
+	}
+	m_entries.shrink_to_fit();
+}
+
+void ChromaKernel::apply(const float *power, float *out) const
+{
+	for (size_t i = 0; i < PITCH_CLASSES; ++i)
+		out[i] = 0.0f;
+	for (const Entry &e : m_entries)
+		out[e.pitch_class] += power[e.bin] * e.weight;
+
+	float peak = 0.0f;
+	for (size_t i = 0; i < PITCH_CLASSES; ++i)
+		peak = out[i] > peak ? out[i] : peak;
+	if (peak > 0.0f) {
+		const float inv = 1.0f / peak;
+		for (size_t i = 0; i < PITCH_CLASSES; ++i)
+			out[i] *= inv;
+	}
+}
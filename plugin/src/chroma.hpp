@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 把 FFT 功率譜折算成 12 個音級（C, C#, ... B）。
+// 每個 bin 依其對數頻率分攤到相鄰的兩個音級，權重在 build() 時一次算好，
+// apply() 只掃描一次設定的八度範圍內的 bin。
+
+class ChromaKernel {
+public:
+	static const size_t PITCH_CLASSES = 12;
+
+	// a4_hz 為 A4 參考音高；八度以科學音高記號表示（C4 = 中央 C），涵蓋 [min_octave, max_octave]
+	void build(float sample_rate, size_t fft_size, float a4_hz, int min_octave, int max_octave);
+
+	size_t fft_size() const { return m_fft_size; }
+
+	// power 長度需為 fft_size / 2 + 1；輸出以最大值正規化到 0..1
+	void apply(const float *power, float *out) const;
+
+private:
+	struct Entry {
+		uint32_t bin;
+		uint32_t pitch_class;
+		float weight;
+	};
+
+	std::vector<Entry> m_entries; // 依 bin 排序
+	size_t m_fft_size = 0;
+};
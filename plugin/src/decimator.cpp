@@ -0,0 +1,54 @@
+#include "decimator.hpp"
+
+#include <cmath>
+
+HalfBandDecimator::HalfBandDecimator()
+{
+	// Blackman 窗的 sinc，截止在 fs/4：半頻帶濾波器除了中心外只有奇數距離的係數不為 0
+	const double pi = 3.14159265358979323846;
+	const double half = (double)(TAPS - 1) / 2.0;
+	double sum = 0.5;
+	for (size_t k = 0; k < PAIRS; ++k) {
+		const double d = (double)(2 * k + 1);
+		const double n = half + d;
+		const double window = 0.42 - 0.5 * cos(2.0 * pi * n / (double)(TAPS - 1)) +
+				      0.08 * cos(4.0 * pi * n / (double)(TAPS - 1));
+		const double h = sin(pi * d / 2.0) / (pi * d) * window;
+		m_taps[k] = (float)h;
+		sum += 2.0 * h;
+	}
+	// 正規化為直流增益 1，bar 的刻度不因抽取而改變
+	m_center = (float)(0.5 / sum);
+	for (float &t : m_taps)
+		t = (float)(t / sum);
+}
+
+void HalfBandDecimator::reset()
+{
+	m_line.fill(0.0f);
+	m_pos = 0;
+	m_odd = false;
+}
+
+size_t HalfBandDecimator::process(const float *in, size_t count, float *out)
+{
+	const size_t mid = TAPS / 2;
+	size_t n = 0;
+	for (size_t i = 0; i < count; ++i) {
+		// 最新的樣本在 m_pos，往後依序變舊
+		m_pos = (m_pos == 0 ? TAPS : m_pos) - 1;
+		m_line[m_pos] = in[i];
+		m_line[m_pos + TAPS] = in[i];
+
+		m_odd = !m_odd;
+		if (m_odd)
+			continue;
+
+		const float *x = m_line.data() + m_pos;
+		float acc = m_center * x[mid];
+		for (size_t k = 0; k < PAIRS; ++k)
+			acc += m_taps[k] * (x[mid - 1 - 2 * k] + x[mid + 1 + 2 * k]);
+		out[n++] = acc;
+	}
+	return n;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+// 2:1 抽取：半頻帶 FIR 低通後每兩個樣本取一個。
+// 原取樣率 1/4 以上的內容在抽取前就被濾掉，不會折回降頻後的頻譜。
+// 濾波器的過渡帶緊貼新的 Nyquist，頻段只應使用到 PASSBAND 為止。
+// 不配置記憶體，只在音訊執行緒使用。
+
+class HalfBandDecimator {
+public:
+	// 中心以外的非零係數對數；長度 4 * PAIRS - 1
+	static const size_t PAIRS = 16;
+	static const size_t TAPS = 4 * PAIRS - 1;
+	// 可信的頻率上限，相對於抽取後的取樣率
+	static constexpr float PASSBAND = 0.4f;
+
+	HalfBandDecimator();
+
+	void reset();
+
+	// out 至少需容納 (count + 1) / 2 個樣本，回傳實際輸出的數量
+	size_t process(const float *in, size_t count, float *out);
+
+private:
+	std::array<float, PAIRS> m_taps; // 中心兩側對稱的係數（距離 1, 3, 5, ...）
+	float m_center = 0.5f;
+
+	// 延遲線存兩份，任何位置起的 TAPS 個樣本都是連續的，不必取餘數
+	std::array<float, 2 * TAPS> m_line{};
+	size_t m_pos = 0;
+	bool m_odd = false; // 已收到半對樣本，下一個樣本才輸出
+};
@@ -0,0 +1,98 @@
+#include "features.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// 平坦度不需要精確的對數：以指數位元加上尾數的多項式近似 log2，
+// 迴圈中沒有函式呼叫，編譯器可以整段向量化
+static inline float fast_log2(float x)
+{
+	uint32_t bits;
+	memcpy(&bits, &x, sizeof(bits));
+	const float exponent = (float)(int32_t)((bits >> 23) & 0xff) - 128.0f;
+	bits = (bits & 0x007fffffu) | 0x3f800000u; // 尾數放回 [1, 2)
+	float m;
+	memcpy(&m, &bits, sizeof(m));
+	// log2(m) + 1 在 [1, 2) 上的二次近似，誤差約 5e-3
+	return exponent + ((-0.34484843f * m + 2.02466578f) * m - 0.67487759f);
+}
+
+void fold_features(float *acc, const float *next, size_t count)
+{
+	const float weight = 1.0f / (float)(count + 1);
+	for (size_t i = 0; i < FEATURE_COUNT; ++i) {
+		if (i == FEATURE_FLUX || i == FEATURE_CREST)
+			acc[i] = count ? std::max(acc[i], next[i]) : next[i];
+		else
+			acc[i] += (next[i] - acc[i]) * weight;
+	}
+}
+
+void FeatureExtractor::reserve(size_t max_fft_size)
+{
+	m_prev.assign(max_fft_size / 2 + 1, 0.0f);
+	m_prev_bins = 0;
+	m_has_prev = false;
+}
+
+void FeatureExtractor::compute(const float *power, size_t fft_size, float sample_rate, float rms, float peak,
+			       size_t crossings, size_t frames, float *out)
+{
+	for (size_t i = 0; i < FEATURE_COUNT; ++i)
+		out[i] = 0.0f;
+
+	out[FEATURE_ZCR] = frames ? (float)crossings / (float)frames : 0.0f;
+	out[FEATURE_CREST] = rms > 0.0f ? peak / rms : 0.0f;
+
+	const size_t bins = fft_size / 2 + 1;
+	if (bins < 2 || bins > m_prev.size())
+		return;
+	if (!power) {
+		// 低於噪聲門檻視為無聲：上一幀記為全 0，恢復發聲的第一幀 flux 即為 1
+		std::fill(m_prev.begin(), m_prev.begin() + bins, 0.0f);
+		m_prev_bins = bins;
+		m_has_prev = true;
+		return;
+	}
+	// 視窗長度改變（換品質等級）時上一幀對不上，flux 從這一幀重新起算
+	const bool has_prev = m_has_prev && m_prev_bins == bins;
+	m_prev_bins = bins;
+	float *prev = m_prev.data();
+
+	// 單次掃描：總能量、一階矩、log2 和、增加的能量，並把這一幀留給下一次（略過 DC）
+	float total = 0.0f;
+	float moment = 0.0f;
+	float log_sum = 0.0f;
+	float rising = 0.0f;
+	for (size_t k = 1; k < bins; ++k) {
+		const float p = power[k];
+		const float d = p - prev[k];
+		total += p;
+		moment += p * (float)k;
+		log_sum += fast_log2(p + 1e-20f);
+		rising += d > 0.0f ? d : 0.0f;
+		prev[k] = p;
+	}
+	m_has_prev = true;
+	if (total <= 0.0f)
+		return;
+
+	const float bin_hz = sample_rate / (float)fft_size;
+	const float n = (float)(bins - 1);
+	out[FEATURE_CENTROID] = moment / total * bin_hz;
+	out[FEATURE_FLATNESS] = std::min(1.0f, exp2f(log_sum / n) / (total / n));
+	out[FEATURE_FLUX] = has_prev ? rising / total : 0.0f;
+
+	// rolloff 需要總能量，只能另外從低頻往上掃，到 85% 即停
+	const float threshold = 0.85f * total;
+	float acc = 0.0f;
+	size_t k = 1;
+	for (; k < bins - 1; ++k) {
+		acc += power[k];
+		if (acc >= threshold)
+			break;
+	}
+	out[FEATURE_ROLLOFF] = (float)k * bin_hz;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// 每幀的聲音特徵描述，給前端驅動顏色 / 動態。索引即送出的陣列順序
+enum AudioFeature : size_t {
+	FEATURE_CENTROID, // 頻譜重心（Hz）
+	FEATURE_ROLLOFF,  // 85% 能量以下的頻率（Hz）
+	FEATURE_FLATNESS, // 幾何平均 / 算術平均：0 接近純音，1 接近白噪
+	FEATURE_FLUX,     // 比上一幀增加的能量佔總能量的比例（0..1），起音時變大
+	FEATURE_ZCR,      // 每個樣本的過零率（0..1）
+	FEATURE_CREST,    // 峰值 / RMS（正弦波約 1.41，打擊樂更高）
+	FEATURE_COUNT,
+};
+
+// 把多幀的特徵合併成一筆，給送出間隔比分析間隔長的地方使用：
+// flux 與 crest 取最大，起音的尖峰不會因為落在沒送出的幀而消失；其他取平均。
+// acc 已合併了 count 幀，count 為 0 時直接複製 next
+void fold_features(float *acc, const float *next, size_t count);
+
+// 從已經算好的功率譜與時域統計求出特徵向量。
+// 時域部分（RMS、峰值、過零數）由呼叫端在計算 RMS 的同一個迴圈中累加；
+// 頻譜部分只掃描一次 power，同時更新 flux 需要的上一幀。
+
+class FeatureExtractor {
+public:
+	// 清掉上一幀的頻譜，下一幀的 flux 為 0
+	void reset() { m_has_prev = false; }
+
+	// 在控制執行緒預先配置上一幀的緩衝，compute 不再配置記憶體
+	void reserve(size_t max_fft_size);
+
+	// power 長度需為 fft_size / 2 + 1，out 長度需為 FEATURE_COUNT。
+	// fft_size 超過 reserve 的大小時只輸出時域特徵
+	void compute(const float *power, size_t fft_size, float sample_rate, float rms, float peak,
+		     size_t crossings, size_t frames, float *out);
+
+private:
+	std::vector<float> m_prev; // 固定配置 reserve 時的最大長度
+	size_t m_prev_bins = 0;    // 上一幀實際使用的長度
+	bool m_has_prev = false;
+};
@@ -0,0 +1,87 @@
+#include "frame_delay_line.hpp"
+
+void FrameDelayLine::configure(size_t capacity)
+{
+	if (capacity < 2)
+		capacity = 2;
+	m_slots.assign(capacity, AnalysisFrame());
+	m_write = 0;
+	m_read = 0;
+	m_last_push = 0;
+	set_delay(m_delay_ns.load());
+}
+
+void FrameDelayLine::set_delay(uint64_t delay_ns)
+{
+	m_delay_ns.store(delay_ns, std::memory_order_relaxed);
+	// 保留幾個槽位給 tick 與音訊區塊之間的抖動
+	const size_t usable = m_slots.size() > 8 ? m_slots.size() - 8 : 1;
+	m_min_spacing_ns.store(delay_ns / usable, std::memory_order_relaxed);
+}
+
+AnalysisFrame *FrameDelayLine::begin_push(uint64_t timestamp)
+{
+	if (m_slots.empty())
+		return nullptr;
+	const uint64_t spacing = m_min_spacing_ns.load(std::memory_order_relaxed);
+	if (spacing && m_last_push && timestamp > m_last_push && timestamp - m_last_push < spacing)
+		return nullptr;
+
+	const size_t write = m_write.load(std::memory_order_relaxed);
+	const size_t read = m_read.load(std::memory_order_acquire);
+	if (write - read >= m_slots.size())
+		return nullptr;
+
+	AnalysisFrame *slot = &m_slots[write % m_slots.size()];
+	slot->timestamp = timestamp;
+	return slot;
+}
+
+void FrameDelayLine::commit_push()
+{
+	const size_t write = m_write.load(std::memory_order_relaxed);
+	m_last_push = m_slots[write % m_slots.size()].timestamp;
+	m_write.store(write + 1, std::memory_order_release);
+}
+
+bool FrameDelayLine::release(uint64_t now, AnalysisFrame &out)
+{
+	if (m_slots.empty())
+		return false;
+	const uint64_t delay = m_delay_ns.load(std::memory_order_relaxed);
+	const size_t write = m_write.load(std::memory_order_acquire);
+	size_t read = m_read.load(std::memory_order_relaxed);
+
+	// 時間戳記遠超過現在（來源時鐘異常）時直接放行，避免佇列卡住
+	const uint64_t max_ahead = delay + 10000000000ULL;
+
+	// 特徵未經平滑，跳過的幀也要合併進來
+	size_t found = 0;
+	while (read != write) {
+		const AnalysisFrame &f = m_slots[read % m_slots.size()];
+		if (f.timestamp + delay > now && f.timestamp < now + max_ahead)
+			break;
+		fold_features(out.features.data(), f.features.data(), found);
+		++found;
+		++read;
+	}
+	if (!found)
+		return false;
+
+	// 其餘只複製最新一幀，並且只複製有效的頻段
+	const AnalysisFrame &latest = m_slots[(read - 1) % m_slots.size()];
+	out.timestamp = latest.timestamp;
+	out.silent = latest.silent;
+	out.band_count = latest.band_count;
+	for (size_t i = 0; i < latest.band_count; ++i)
+		out.bars[i] = latest.bars[i];
+	out.chroma = latest.chroma;
+
+	m_read.store(read, std::memory_order_release);
+	return true;
+}
+
+void FrameDelayLine::clear()
+{
+	m_read.store(m_write.load(std::memory_order_acquire), std::memory_order_release);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "band_layout.hpp"
+#include "chroma.hpp"
+#include "features.hpp"
+
+// 一次分析的結果，以音訊時間戳記標記
+struct AnalysisFrame {
+	uint64_t timestamp = 0; // 音訊時間（ns，與 os_gettime_ns 同一時鐘）
+	bool silent = false;
+	size_t band_count = 0;
+	std::array<float, BandLayout::MAX_BANDS> bars;
+	std::array<float, ChromaKernel::PITCH_CLASSES> chroma;
+	std::array<float, FEATURE_COUNT> features;
+};
+
+// 單一生產者（音訊執行緒）/ 單一消費者（video tick）的延遲佇列。
+// 幀在 timestamp + delay 到達之前不會被取出，讓畫面與觀眾聽到的聲音對齊。
+// 緩衝在 configure() 時一次配置，之後 push / release 都不配置記憶體也不上鎖。
+
+class FrameDelayLine {
+public:
+	// 需在沒有生產者 / 消費者時呼叫
+	void configure(size_t capacity);
+
+	// 生產者：取得下一個可寫入的槽位，佇列已滿或距上一幀太近時回傳 nullptr
+	AnalysisFrame *begin_push(uint64_t timestamp);
+	void commit_push();
+
+	// 消費者：設定延遲（ns）。延遲越長，生產者的最小間隔越大，讓容量平均涵蓋整段延遲
+	void set_delay(uint64_t delay_ns);
+	uint64_t delay() const { return m_delay_ns.load(std::memory_order_relaxed); }
+
+	// 消費者：取出所有 timestamp + delay <= now 的幀，把最新的一幀複製到 out；
+	// 特徵則是所有取出的幀以 fold_features 合併的結果
+	bool release(uint64_t now, AnalysisFrame &out);
+
+	// 消費者：丟棄所有尚未取出的幀
+	void clear();
+
+private:
+	std::vector<AnalysisFrame> m_slots;
+	std::atomic<size_t> m_write{0}; // 只由生產者遞增
+	std::atomic<size_t> m_read{0};  // 只由消費者遞增
+	std::atomic<uint64_t> m_delay_ns{0};
+	std::atomic<uint64_t> m_min_spacing_ns{0};
+	uint64_t m_last_push = 0; // 僅生產者使用
+};
@@ -0,0 +1,25 @@
+#pragma once
+
+// 共用程式碼（伺服器、分析）只透過 blog() 記錄日誌：
+// 在 OBS 插件中就是 libobs 的 blog()；獨立 daemon 以 AUDIO_WS_STANDALONE 編譯，自行提供實作。
+
+#ifdef AUDIO_WS_STANDALONE
+
+enum {
+	LOG_ERROR = 100,
+	LOG_WARNING = 200,
+	LOG_INFO = 300,
+	LOG_DEBUG = 400,
+};
+
+void blog(int log_level, const char *format, ...)
+#if defined(__GNUC__) || defined(__clang__)
+	__attribute__((format(printf, 2, 3)))
+#endif
+	;
+
+#else
+
+#include <util/base.h>
+
+#endif
@@ -1,5 +1,9 @@
 #include <obs-module.h>
+#include <util/platform.h>
 #include "audio_ws_source.hpp"
+#include "websocket_server.hpp"
+
+#include <mutex>
 
 OBS_DECLARE_MODULE()
 OBS_MODULE_USE_DEFAULT_LOCALE("obs-audio-ws-plugin", "en-US")
@@ -16,6 +20,28 @@ MODULE_EXPORT const char *obs_module_description(void)
 
 extern struct obs_source_info audio_ws_source_info;
 
+WebSocketServer *GetGlobalWebSocketServer()
+{
+	// lazy singleton，首次呼叫時建立並啟動在 127.0.0.1:9450。
+	// UI（update）與 video（tick）執行緒都可能先呼叫，建立過程需上鎖
+	static std::mutex create_mutex;
+	static WebSocketServer *server = nullptr;
+	std::lock_guard<std::mutex> lock(create_mutex);
+	if (!server) {
+		server = new WebSocketServer();
+		// 幀的時間戳記來自 os_gettime_ns，歷史的距今時間也要以它計算
+		server->setClock(os_gettime_ns);
+		// 前端 widget 隨插件安裝在模組資料目錄，由同一個 port 提供
+		char *root = obs_module_file("frontend");
+		if (root) {
+			server->setAssetRoot(root);
+			bfree(root);
+		}
+		server->start(9450);
+	}
+	return server;
+}
+
 MODULE_EXPORT bool obs_module_load(void)
 {
 	obs_register_source(&audio_ws_source_info);
@@ -0,0 +1,231 @@
+#include "pcm_reader.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static uint16_t get_u16(const uint8_t *p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+	return (uint32_t)get_u16(p) | ((uint32_t)get_u16(p + 2) << 16);
+}
+
+static size_t sample_bytes(PcmSampleFormat format)
+{
+	return format == PcmSampleFormat::S16 ? 2 : 4;
+}
+
+static float decode_sample(const uint8_t *p, PcmSampleFormat format)
+{
+	if (format == PcmSampleFormat::S16)
+		return (float)(int16_t)get_u16(p) / 32768.0f;
+	uint32_t bits = get_u32(p);
+	float v;
+	memcpy(&v, &bits, sizeof(v));
+	return v;
+}
+
+PcmReader::~PcmReader()
+{
+	close();
+}
+
+bool PcmReader::open(const std::string &path, const PcmFormat &format, size_t block_frames)
+{
+	close();
+	m_format = format;
+	m_block_frames = block_frames ? block_frames : 1024;
+	m_data_remaining = UINT64_MAX;
+	m_wav = false;
+	m_error.clear();
+
+	if (path.empty() || path == "-") {
+		m_fd = STDIN_FILENO;
+		m_owns_fd = false;
+	} else {
+		// FIFO 會在這裡等到有寫入端才返回
+		m_fd = ::open(path.c_str(), O_RDONLY);
+		if (m_fd < 0) {
+			m_error = path + ": " + strerror(errno);
+			return false;
+		}
+		m_owns_fd = true;
+	}
+
+	struct stat st;
+	m_regular = fstat(m_fd, &st) == 0 && S_ISREG(st.st_mode);
+
+	// 先讀 12 bytes 判斷是否為 WAV；不是的話這些資料仍屬於 PCM 串流
+	uint8_t head[12];
+	size_t got = read_bytes(head, sizeof(head));
+	if (got == sizeof(head) && memcmp(head, "RIFF", 4) == 0 && memcmp(head + 8, "WAVE", 4) == 0) {
+		m_wav = true;
+		if (!parse_wav()) {
+			close();
+			return false;
+		}
+	} else {
+		m_pending.assign((const char *)head, got);
+	}
+
+	if (m_format.channels == 0 || m_format.sample_rate == 0) {
+		m_error = "invalid channel count or sample rate";
+		close();
+		return false;
+	}
+	m_raw.resize(m_block_frames * m_format.channels * sample_bytes(m_format.sample_format));
+	m_mono.resize(m_block_frames);
+	return true;
+}
+
+void PcmReader::close()
+{
+	if (m_fd >= 0 && m_owns_fd)
+		::close(m_fd);
+	m_fd = -1;
+	m_owns_fd = false;
+	m_pending.clear();
+}
+
+size_t PcmReader::read_bytes(void *dst, size_t size)
+{
+	uint8_t *out = (uint8_t *)dst;
+	size_t done = 0;
+
+	if (!m_pending.empty()) {
+		size_t n = m_pending.size() < size ? m_pending.size() : size;
+		memcpy(out, m_pending.data(), n);
+		m_pending.erase(0, n);
+		done = n;
+	}
+
+	while (done < size && m_fd >= 0) {
+		if (m_stop && m_stop->load())
+			break;
+		// 以短逾時輪詢，才能在 pipe 沒有資料時回應停止要求
+		pollfd pfd{m_fd, POLLIN, 0};
+		int ready = poll(&pfd, 1, 200);
+		if (ready < 0 && errno != EINTR) {
+			m_error = strerror(errno);
+			break;
+		}
+		if (ready <= 0)
+			continue;
+
+		ssize_t n = ::read(m_fd, out + done, size - done);
+		if (n < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			m_error = strerror(errno);
+			break;
+		}
+		if (n == 0)
+			break;
+		done += (size_t)n;
+	}
+	return done;
+}
+
+bool PcmReader::skip_bytes(uint64_t size)
+{
+	uint8_t buf[512];
+	while (size > 0) {
+		size_t chunk = size < sizeof(buf) ? (size_t)size : sizeof(buf);
+		if (read_bytes(buf, chunk) != chunk)
+			return false;
+		size -= chunk;
+	}
+	return true;
+}
+
+bool PcmReader::parse_wav()
+{
+	// RIFF 內依序掃描 chunk，取 "fmt " 的格式，停在 "data" 開頭
+	bool have_fmt = false;
+	for (;;) {
+		uint8_t chunk[8];
+		if (read_bytes(chunk, sizeof(chunk)) != sizeof(chunk)) {
+			m_error = "truncated WAV header";
+			return false;
+		}
+		const uint32_t size = get_u32(chunk + 4);
+
+		if (memcmp(chunk, "fmt ", 4) == 0) {
+			uint8_t fmt[40] = {};
+			const size_t want = size < sizeof(fmt) ? size : sizeof(fmt);
+			if (want < 16 || read_bytes(fmt, want) != want || !skip_bytes(size - want + (size & 1))) {
+				m_error = "truncated WAV fmt chunk";
+				return false;
+			}
+			uint16_t tag = get_u16(fmt);
+			const uint16_t bits = get_u16(fmt + 14);
+			// WAVE_FORMAT_EXTENSIBLE：真正的格式在 SubFormat GUID 的前兩個 byte
+			if (tag == 0xFFFE && want >= 26)
+				tag = get_u16(fmt + 24);
+
+			if (tag == 1 && bits == 16) {
+				m_format.sample_format = PcmSampleFormat::S16;
+			} else if (tag == 3 && bits == 32) {
+				m_format.sample_format = PcmSampleFormat::F32;
+			} else {
+				m_error = "unsupported WAV encoding (need 16-bit PCM or 32-bit float)";
+				return false;
+			}
+			m_format.channels = get_u16(fmt + 2);
+			m_format.sample_rate = get_u32(fmt + 4);
+			m_format.planar = false;
+			have_fmt = true;
+		} else if (memcmp(chunk, "data", 4) == 0) {
+			if (!have_fmt) {
+				m_error = "WAV data chunk before fmt chunk";
+				return false;
+			}
+			// 串流輸出（例如 arecord 寫到 stdout）時長度欄位不可靠，0 / 最大值都視為讀到 EOF 為止
+			m_data_remaining = (size == 0 || size >= 0x7FFFF000u) ? UINT64_MAX : size;
+			return true;
+		} else if (!skip_bytes((uint64_t)size + (size & 1))) {
+			m_error = "truncated WAV header";
+			return false;
+		}
+	}
+}
+
+size_t PcmReader::read_block(const float *&mono)
+{
+	mono = m_mono.data();
+	if (m_fd < 0 || m_raw.empty())
+		return 0;
+
+	const size_t bytes = sample_bytes(m_format.sample_format);
+	const size_t frame_bytes = bytes * m_format.channels;
+	size_t want = m_raw.size();
+	if (m_data_remaining < want)
+		want = (size_t)m_data_remaining - (size_t)m_data_remaining % frame_bytes;
+	if (want == 0)
+		return 0;
+
+	const size_t got = read_bytes(m_raw.data(), want);
+	if (m_data_remaining != UINT64_MAX)
+		m_data_remaining -= got;
+
+	// 不足一個完整 frame 的尾端直接丟棄
+	const size_t frames = got / frame_bytes;
+	const PcmSampleFormat format = m_format.sample_format;
+	if (m_format.planar) {
+		// 最後一塊不足時，聲道 0 仍位於區塊開頭
+		for (size_t i = 0; i < frames; ++i)
+			m_mono[i] = decode_sample(m_raw.data() + i * bytes, format);
+	} else {
+		for (size_t i = 0; i < frames; ++i)
+			m_mono[i] = decode_sample(m_raw.data() + i * frame_bytes, format);
+	}
+	return frames;
+}
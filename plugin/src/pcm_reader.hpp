@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 獨立 daemon 的音訊輸入：從 stdin、FIFO 或檔案讀取 PCM（僅 POSIX）。
+// raw PCM 的格式由呼叫端指定；開頭是 RIFF/WAVE 標頭時自動改用標頭中的格式。
+
+enum class PcmSampleFormat {
+	F32, // 32-bit float，little endian
+	S16, // 16-bit signed，little endian
+};
+
+struct PcmFormat {
+	uint32_t sample_rate = 48000;
+	uint32_t channels = 2;
+	PcmSampleFormat sample_format = PcmSampleFormat::F32;
+	// planar：每個區塊內依聲道分開排列（block_frames 個聲道 0，接著聲道 1 ...），
+	// 否則為逐 frame 交錯排列
+	bool planar = false;
+};
+
+class PcmReader {
+public:
+	~PcmReader();
+
+	// path 為 "-" 時讀 stdin。失敗時回傳 false，原因見 error()
+	bool open(const std::string &path, const PcmFormat &format, size_t block_frames);
+	void close();
+
+	// 讀取時每隔一段時間檢查一次，設為 true 後 read_block() 會盡快回傳 0
+	void set_stop_flag(const std::atomic<bool> *stop) { m_stop = stop; }
+
+	const PcmFormat &format() const { return m_format; }
+	bool is_wav() const { return m_wav; }
+	// 一般檔案不會自己控制速度，需要依取樣率節流才像即時音訊
+	bool is_regular_file() const { return m_regular; }
+	const std::string &error() const { return m_error; }
+
+	// 讀一個區塊並取出第一個聲道（與插件相同），mono 指向內部緩衝。
+	// 回傳 frame 數，最後一塊可能不足 block_frames；0 代表輸入結束、讀取錯誤或被要求停止
+	size_t read_block(const float *&mono);
+
+private:
+	int m_fd = -1;
+	bool m_owns_fd = false;
+	bool m_regular = false;
+	bool m_wav = false;
+	PcmFormat m_format;
+	size_t m_block_frames = 0;
+	uint64_t m_data_remaining = UINT64_MAX; // WAV data chunk 剩餘位元組，raw PCM 不限
+	const std::atomic<bool> *m_stop = nullptr;
+	std::string m_error;
+
+	std::string m_pending; // 偵測標頭時多讀到的資料
+	std::vector<uint8_t> m_raw;
+	std::vector<float> m_mono;
+
+	size_t read_bytes(void *dst, size_t size);
+	bool skip_bytes(uint64_t size);
+	bool parse_wav();
+};
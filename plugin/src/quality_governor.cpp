@@ -0,0 +1,57 @@
+#include "quality_governor.hpp"
+
+// 每降一級成本大約減半：升級門檻取預算的 35%，升回去後約為 70%，不會馬上又超過
+static const float STEP_UP_RATIO = 0.35f;
+// 降級要快（避免音訊爆音），升級要慢（確認餘裕是持續的）
+static const double STEP_DOWN_HOLD = 0.5;
+static const double STEP_UP_HOLD = 5.0;
+// 負載的指數平均係數，約以 10 次分析為時間常數
+static const float LOAD_SMOOTHING = 0.1f;
+
+void QualityGovernor::set_budget(float budget)
+{
+	if (budget < 0.0f)
+		budget = 0.0f;
+	if (budget == m_budget)
+		return;
+	m_budget = budget;
+	if (m_budget == 0.0f)
+		m_level = 0;
+	m_since_change = 0.0;
+}
+
+void QualityGovernor::reset()
+{
+	m_load = 0.0f;
+	m_primed = false;
+	m_since_change = 0.0;
+}
+
+int QualityGovernor::report(double cost_seconds, double audio_seconds)
+{
+	if (audio_seconds <= 0.0)
+		return m_level;
+
+	const float load = (float)(cost_seconds / audio_seconds);
+	if (!m_primed) {
+		m_load = load;
+		m_primed = true;
+	} else {
+		m_load += (load - m_load) * LOAD_SMOOTHING;
+	}
+	m_since_change += audio_seconds;
+
+	if (m_budget <= 0.0f)
+		return m_level;
+
+	if (m_load > m_budget && m_level < LEVELS - 1 && m_since_change >= STEP_DOWN_HOLD) {
+		++m_level;
+		m_load *= 0.5f; // 先以預估值起算，等新等級的量測把它拉到實際值
+		m_since_change = 0.0;
+	} else if (m_load < m_budget * STEP_UP_RATIO && m_level > 0 && m_since_change >= STEP_UP_HOLD) {
+		--m_level;
+		m_load *= 2.0f;
+		m_since_change = 0.0;
+	}
+	return m_level;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+
+// 分析品質調節：量測每個區塊的分析耗時佔其音訊長度的比例（負載），
+// 超過預算時降一級，長時間遠低於預算才升回去，避免在兩級之間來回跳。
+// 只在音訊執行緒使用，不配置記憶體也不上鎖。
+
+class QualityGovernor {
+public:
+	// 0 為完整品質，數字越大越省
+	static const int LEVELS = 4;
+
+	// budget 為可用的即時比例（例如 0.1 = 音訊長度的 10%），0 停用，固定完整品質
+	void set_budget(float budget);
+	// 預算為 0 時固定在完整品質，降級用的分析都用不到
+	bool enabled() const { return m_budget > 0.0f; }
+
+	// 回報一次分析的耗時與其涵蓋的音訊長度（秒），回傳調整後的等級
+	int report(double cost_seconds, double audio_seconds);
+
+	void reset();
+
+	int level() const { return m_level; }
+	// 目前等級下的平均負載（耗時 / 音訊長度）
+	float load() const { return m_load; }
+
+private:
+	float m_budget = 0.0f;
+	float m_load = 0.0f;
+	int m_level = 0;
+	bool m_primed = false;
+	double m_since_change = 0.0; // 距離上次換級的音訊秒數
+};
@@ -0,0 +1,171 @@
+#include "spectrum.hpp"
+
+#include <cmath>
+
+static const float PI_F = 3.14159265358979323846f;
+
+void SpectrumAnalyzer::configure(size_t fft_size)
+{
+	if (fft_size < 16)
+		fft_size = 16;
+	// 取不超過 fft_size 的 2 的次方
+	size_t n = 16;
+	while (n * 2 <= fft_size)
+		n *= 2;
+
+	m_size = n;
+	const size_t half = n / 2;
+
+	m_ring.assign(n, 0.0f);
+	m_window.resize(n);
+	float window_sum = 0.0f;
+	for (size_t i = 0; i < n; ++i) {
+		m_window[i] = 0.5f - 0.5f * cosf(2.0f * PI_F * (float)i / (float)n);
+		window_sum += m_window[i];
+	}
+	m_power_scale = window_sum > 0.0f ? 1.0f / window_sum : 0.0f;
+
+	m_re.assign(half, 0.0f);
+	m_im.assign(half, 0.0f);
+	m_cos.resize(half);
+	m_sin.resize(half);
+	for (size_t k = 0; k < half; ++k) {
+		float a = 2.0f * PI_F * (float)k / (float)n;
+		m_cos[k] = cosf(a);
+		m_sin[k] = sinf(a);
+	}
+
+	m_bitrev.resize(half);
+	size_t bits = 0;
+	while (((size_t)1 << bits) < half)
+		++bits;
+	for (size_t i = 0; i < half; ++i) {
+		size_t r = 0;
+		for (size_t b = 0; b < bits; ++b) {
+			if (i & ((size_t)1 << b))
+				r |= (size_t)1 << (bits - 1 - b);
+		}
+		m_bitrev[i] = r;
+	}
+
+	m_power.assign(half + 1, 0.0f);
+	reset();
+}
+
+void SpectrumAnalyzer::reset()
+{
+	for (float &v : m_ring)
+		v = 0.0f;
+	for (float &v : m_power)
+		v = 0.0f;
+	m_write = 0;
+	m_since_rescan = 0;
+	m_energy = 0.0f;
+}
+
+void SpectrumAnalyzer::push(const float *samples, size_t count)
+{
+	if (!m_size)
+		return;
+	// 超過一個視窗長度的部分只保留最後 m_size 個
+	if (count > m_size) {
+		samples += count - m_size;
+		count = m_size;
+	}
+
+	float energy = m_energy;
+	size_t w = m_write;
+	for (size_t i = 0; i < count; ++i) {
+		float s = samples[i];
+		float old = m_ring[w];
+		energy += s * s - old * old;
+		m_ring[w] = s;
+		if (++w == m_size)
+			w = 0;
+	}
+	m_write = w;
+
+	// 累加誤差：每寫滿一個視窗就重新精確計算一次
+	m_since_rescan += count;
+	if (m_since_rescan >= m_size) {
+		m_since_rescan = 0;
+		energy = 0.0f;
+		for (float v : m_ring)
+			energy += v * v;
+	}
+	m_energy = energy > 0.0f ? energy : 0.0f;
+}
+
+float SpectrumAnalyzer::window_energy() const
+{
+	return m_energy;
+}
+
+void SpectrumAnalyzer::fft_half()
+{
+	// 原地 radix-2 FFT（輸入已在載入時做過 bit reversal），長度 N/2
+	const size_t half = m_size / 2;
+	for (size_t len = 2; len <= half; len <<= 1) {
+		const size_t hl = len / 2;
+		const size_t step = (half / len) * 2; // 在長度 N 的 twiddle 表上的步距
+		for (size_t start = 0; start < half; start += len) {
+			for (size_t j = 0; j < hl; ++j) {
+				const float wr = m_cos[j * step];
+				const float wi = -m_sin[j * step];
+				const size_t a = start + j;
+				const size_t b = a + hl;
+				const float tr = m_re[b] * wr - m_im[b] * wi;
+				const float ti = m_re[b] * wi + m_im[b] * wr;
+				m_re[b] = m_re[a] - tr;
+				m_im[b] = m_im[a] - ti;
+				m_re[a] += tr;
+				m_im[a] += ti;
+			}
+		}
+	}
+}
+
+const float *SpectrumAnalyzer::compute()
+{
+	if (!m_size)
+		return m_power.data();
+
+	const size_t n = m_size;
+	const size_t half = n / 2;
+
+	// 從最舊的樣本開始展開環形緩衝並加窗；偶數樣本放實部、奇數放虛部
+	size_t r = m_write;
+	for (size_t i = 0; i < half; ++i) {
+		const size_t dst = m_bitrev[i];
+		m_re[dst] = m_ring[r] * m_window[2 * i];
+		if (++r == n)
+			r = 0;
+		m_im[dst] = m_ring[r] * m_window[2 * i + 1];
+		if (++r == n)
+			r = 0;
+	}
+
+	fft_half();
+
+	// 拆回 N 點實數 FFT：X[k] = Fe[k] + W^k * Fo[k]
+	const float scale = m_power_scale;
+	{
+		const float x0 = m_re[0] + m_im[0];
+		const float xn = m_re[0] - m_im[0];
+		m_power[0] = x0 * x0 * scale;
+		m_power[half] = xn * xn * scale;
+	}
+	for (size_t k = 1; k < half; ++k) {
+		const float a = m_re[k], b = m_im[k];
+		const float c = m_re[half - k], d = m_im[half - k];
+		const float fe_r = 0.5f * (a + c);
+		const float fe_i = 0.5f * (b - d);
+		const float fo_r = 0.5f * (b + d);
+		const float fo_i = -0.5f * (a - c);
+		const float cs = m_cos[k], sn = m_sin[k];
+		const float xr = fe_r + cs * fo_r + sn * fo_i;
+		const float xi = fe_i + cs * fo_i - sn * fo_r;
+		m_power[k] = (xr * xr + xi * xi) * scale;
+	}
+	return m_power.data();
+}
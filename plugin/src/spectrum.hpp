@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// 滑動視窗 + 實數 FFT，輸出功率譜。不依賴 OBS，所有緩衝在 configure() 時配置好，
+// push()/compute() 期間不做任何記憶體配置。
+
+class SpectrumAnalyzer {
+public:
+	// fft_size 必須為 2 的次方（>= 16）
+	void configure(size_t fft_size);
+
+	size_t fft_size() const { return m_size; }
+	size_t bin_count() const { return m_size / 2 + 1; }
+
+	// 把新樣本推進視窗（只保留最近 fft_size 個）
+	void push(const float *samples, size_t count);
+
+	// 視窗內所有樣本的平方和（未加窗），供靜音偵測使用
+	float window_energy() const;
+
+	// 以目前視窗計算功率譜，寫入內部 m_power（長度 bin_count()）。
+	// 刻度為 |X|^2 / sum(window)，與舊版 Goertzel 的 power / frames 對齊。
+	const float *compute();
+	const float *power() const { return m_power.data(); }
+
+	void reset();
+
+private:
+	size_t m_size = 0;
+	size_t m_write = 0;         // 下一個寫入位置
+	size_t m_since_rescan = 0;  // 距離上次重新計算 energy 已寫入的樣本數
+	float m_energy = 0.0f;
+
+	std::vector<float> m_ring;     // 輸入環形緩衝
+	std::vector<float> m_window;   // Hann window
+	float m_power_scale = 0.0f;
+	std::vector<float> m_re;       // N/2 點複數 FFT 工作區
+	std::vector<float> m_im;
+	std::vector<float> m_cos;      // twiddle（N/2 點 FFT 與實數拆分共用，長度 N/2）
+	std::vector<float> m_sin;
+	std::vector<size_t> m_bitrev;  // N/2 點的 bit reversal 表
+	std::vector<float> m_power;
+
+	void fft_half();
+};
@@ -0,0 +1,115 @@
+#include "spectrum_history.hpp"
+
+#include <cmath>
+
+static void put_u16(std::string &out, uint32_t v)
+{
+	out.push_back((char)(v & 0xFF));
+	out.push_back((char)((v >> 8) & 0xFF));
+}
+
+static void put_u32(std::string &out, uint32_t v)
+{
+	put_u16(out, v & 0xFFFF);
+	put_u16(out, v >> 16);
+}
+
+void SpectrumHistory::configure(double seconds, double rate, int bits)
+{
+	size_t capacity = 0;
+	if (seconds > 0.0 && rate > 0.0)
+		capacity = (size_t)ceil(seconds * rate);
+	size_t bytes = bits > 8 ? 2 : 1;
+	uint64_t interval = rate > 0.0 ? (uint64_t)(1000.0 / rate) : 0;
+
+	if (capacity == m_capacity && bytes == m_bytes && interval == m_interval_ms)
+		return;
+
+	m_capacity = capacity;
+	m_bytes = bytes;
+	m_interval_ms = interval;
+	m_times.assign(m_capacity, 0);
+	reset(m_bands);
+}
+
+void SpectrumHistory::reset(size_t bands)
+{
+	m_bands = bands;
+	m_head = 0;
+	m_size = 0;
+	m_last_ms = 0;
+	m_values.assign(m_capacity * m_bands * m_bytes, 0);
+}
+
+void SpectrumHistory::push(uint64_t time_ms, const float *bars, size_t count)
+{
+	if (!m_capacity || !count)
+		return;
+	// 頻段數改變後舊資料無法對齊，直接清空
+	if (count != m_bands)
+		reset(count);
+	if (m_size && time_ms < m_last_ms + m_interval_ms)
+		return;
+	m_last_ms = time_ms;
+
+	m_times[m_head] = time_ms;
+	uint8_t *dst = m_values.data() + m_head * m_bands * m_bytes;
+	const float max_q = m_bytes == 2 ? 65535.0f : 255.0f;
+	for (size_t i = 0; i < count; ++i) {
+		float v = bars[i];
+		if (v < 0.0f)
+			v = 0.0f;
+		if (v > 1.0f)
+			v = 1.0f;
+		uint32_t q = (uint32_t)(v * max_q + 0.5f);
+		if (m_bytes == 2) {
+			dst[i * 2] = (uint8_t)(q & 0xFF);
+			dst[i * 2 + 1] = (uint8_t)(q >> 8);
+		} else {
+			dst[i] = (uint8_t)q;
+		}
+	}
+
+	m_head = (m_head + 1) % m_capacity;
+	if (m_size < m_capacity)
+		++m_size;
+}
+
+bool SpectrumHistory::encode(std::string &out, uint64_t now_ms, uint64_t since_ms, uint64_t until_ms) const
+{
+	out.clear();
+
+	// 由舊到新找出落在範圍內的幀
+	const size_t oldest = m_capacity ? (m_head + m_capacity - m_size) % m_capacity : 0;
+	size_t first = m_size;
+	size_t last = 0;
+	for (size_t i = 0; i < m_size && until_ms <= since_ms; ++i) {
+		const uint64_t t = m_times[(oldest + i) % m_capacity];
+		const uint64_t age = now_ms > t ? now_ms - t : 0;
+		if (age <= since_ms && age >= until_ms) {
+			if (first == m_size)
+				first = i;
+			last = i;
+		}
+	}
+	const size_t frames = first == m_size ? 0 : last - first + 1;
+	const size_t stride = m_bands * m_bytes;
+	out.reserve(8 + frames * (4 + stride));
+	out.push_back((char)MESSAGE_KIND);
+	out.push_back((char)m_bytes);
+	put_u16(out, (uint32_t)m_bands);
+	put_u32(out, (uint32_t)frames);
+	if (!frames)
+		return false;
+
+	for (size_t i = first; i <= last; ++i) {
+		const uint64_t t = m_times[(oldest + i) % m_capacity];
+		const uint64_t age = now_ms > t ? now_ms - t : 0;
+		put_u32(out, (uint32_t)(age > 0xFFFFFFFFULL ? 0xFFFFFFFFULL : age));
+	}
+	for (size_t i = first; i <= last; ++i) {
+		const uint8_t *src = m_values.data() + ((oldest + i) % m_capacity) * stride;
+		out.append((const char *)src, stride);
+	}
+	return true;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 最近 N 秒頻譜的環形緩衝，量化為 uint8 / uint16 以節省記憶體。
+// 只在設定或頻段數改變時配置，push() 不配置記憶體。
+//
+// encode() 產生的 backfill 訊息（little endian）：
+//   u8  kind = 1（history）
+//   u8  每個值的 byte 數（1 或 2）
+//   u16 頻段數
+//   u32 frame 數
+//   u32 × frames   每幀距離 now_ms 的毫秒數（由舊到新）
+//   值 × frames × bands，0..255 或 0..65535 對應 0..1
+
+class SpectrumHistory {
+public:
+	static const uint8_t MESSAGE_KIND = 1;
+
+	// seconds <= 0 表示停用；rate 為每秒最多記錄幾幀；bits 為 8 或 16
+	void configure(double seconds, double rate, int bits);
+
+	bool enabled() const { return m_capacity > 0; }
+
+	void push(uint64_t time_ms, const float *bars, size_t count);
+
+	// 將 age 介於 [until_ms, since_ms] 之間的幀編進 out（會先清空）。
+	// 沒有資料時仍輸出 frame 數為 0 的訊息，並回傳 false
+	bool encode(std::string &out, uint64_t now_ms, uint64_t since_ms, uint64_t until_ms) const;
+
+	size_t memory_usage() const { return m_values.size() + m_times.size() * sizeof(uint64_t); }
+
+private:
+	size_t m_capacity = 0; // 幀數上限
+	size_t m_head = 0;     // 下一個寫入位置
+	size_t m_size = 0;
+	size_t m_bands = 0;
+	size_t m_bytes = 1;
+	uint64_t m_interval_ms = 0;
+	uint64_t m_last_ms = 0;
+
+	std::vector<uint8_t> m_values;
+	std::vector<uint64_t> m_times;
+
+	void reset(size_t bands);
+};
@@ -13,7 +13,9 @@ typedef SOCKET socket_t;
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/time.h>
 #include <sys/select.h>
 #include <errno.h>
@@ -24,26 +26,44 @@ typedef int socket_t;
 #endif
 
 #include <sstream>
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <chrono>
 #include <cmath>
-#include <obs-module.h>
+#include <charconv>
+#include <future>
+#include "log.hpp"
 
 #define ws_blog(level, msg, ...) blog(level, "audio-ws-ws: " msg, __VA_ARGS__)
 
-static WebSocketServer *g_server = nullptr;
+static const double HISTORY_RATE = 30.0; // 歷史緩衝每秒記錄的幀數
 
-WebSocketServer *GetGlobalWebSocketServer()
+static uint64_t steady_now_ns()
 {
-	// lazy singleton，首次呼叫時建立並啟動在 127.0.0.1:9450
-	if (!g_server) {
-		g_server = new WebSocketServer();
-		g_server->start(9450);
-	}
-	return g_server;
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		       std::chrono::steady_clock::now().time_since_epoch())
+		.count();
+}
+
+WebSocketServer::WebSocketServer() : m_clock(steady_now_ns) {}
+
+void WebSocketServer::setClock(uint64_t (*now_ns)())
+{
+	m_clock = now_ns ? now_ns : steady_now_ns;
 }
 
-WebSocketServer::WebSocketServer() {}
+void WebSocketServer::setAssetRoot(const std::string &root)
+{
+	m_asset_root = root;
+}
+
+void WebSocketServer::setBindAddress(const std::string &address)
+{
+	m_bind_address = address;
+}
 
 WebSocketServer::~WebSocketServer()
 {
@@ -55,43 +75,445 @@ bool WebSocketServer::start(uint16_t port)
 	if (m_running.load())
 		return true;
 
+	// 等伺服器執行緒開好監聽 socket 再回傳，bind / listen 失敗時呼叫端才知道
+	std::promise<bool> ready;
+	std::future<bool> listening = ready.get_future();
 	m_running = true;
-	m_thread = std::thread([this, port]() { run(port); });
-	if (!g_server)
-		g_server = this;
-	return true;
+	// promise 交給執行緒持有，set_value 之後 start() 返回也不會讓它失效
+	m_thread = std::thread([this, port](std::promise<bool> p) { run(port, p); }, std::move(ready));
+	if (listening.get())
+		return true;
+	m_thread.join();
+	m_running = false;
+	return false;
 }
 
 void WebSocketServer::stop()
 {
-	if (!m_running.load())
-		return;
 	m_running = false;
+	wake();
+	// 不看 m_running：只要還有未 join 的執行緒就 join，否則解構時 std::terminate
 	if (m_thread.joinable())
 		m_thread.join();
 }
 
-void WebSocketServer::setBars(const std::array<float, 12> &bars)
+void WebSocketServer::setBars(const float *bars, size_t count, uint64_t timestamp_ns)
+{
+	if (count > m_bars.size())
+		count = m_bars.size();
+
+	bool silent = true;
+	for (size_t i = 0; i < count; ++i) {
+		if (bars[i] > 0.0f) {
+			silent = false;
+			break;
+		}
+	}
+
+	bool resume = false;
+	{
+		std::lock_guard<std::mutex> lock(m_data_mutex);
+		std::copy(bars, bars + count, m_bars.begin());
+		m_bar_count = count;
+		m_bars_time = timestamp_ns;
+		// 以幀本身的時間記錄，和送出的 "t" 同一個時鐘
+		m_history.push(timestamp_ns / 1000000ULL, bars, count);
+		resume = m_silent && !silent;
+		m_silent = silent;
+	}
+	// 從靜音恢復時立即喚醒推送 loop，不必等到下一次 keep-alive
+	if (resume)
+		wake();
+}
+
+void WebSocketServer::setChroma(const float *chroma, uint64_t timestamp_ns)
 {
 	std::lock_guard<std::mutex> lock(m_data_mutex);
-	m_bars = bars;
+	std::copy(chroma, chroma + m_chroma.size(), m_chroma.begin());
+	m_chroma_time = timestamp_ns;
 }
 
-// 簡化：此處實作一個非常基本的 WebSocket server，僅支援單連線、text frame、無分片
+void WebSocketServer::setFeatures(const float *features, uint64_t timestamp_ns)
+{
+	// 推送間隔（60ms）比 tick 長，兩次推送之間的每一筆都合併進來
+	std::lock_guard<std::mutex> lock(m_data_mutex);
+	fold_features(m_features.data(), features, m_features_folded++);
+	m_features_time = timestamp_ns;
+}
 
-static bool recv_line(socket_t s, std::string &out)
+void WebSocketServer::setHistory(double seconds, int bits)
 {
-	out.clear();
-	char c = 0;
-	while (true) {
-		int r = recv(s, &c, 1, 0);
-		if (r <= 0) return false;
-		if (c == '\n') break;
-		if (c != '\r') out.push_back(c);
+	std::lock_guard<std::mutex> lock(m_data_mutex);
+	m_history.configure(seconds, HISTORY_RATE, bits);
+	m_history_ms = seconds > 0.0 ? (uint64_t)(seconds * 1000.0) : 0;
+}
+
+void WebSocketServer::wake()
+{
+	intptr_t s = m_wake_sock.load();
+	if (s != -1)
+		send((socket_t)s, "w", 1, 0);
+}
+
+// 簡化：此處實作一個基本的 HTTP/WebSocket server，select() 多工、非阻塞 socket、
+// 只收發不分片的 frame，用戶端只會送來小型 JSON 指令。
+
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+static const size_t MAX_CONNECTIONS = 32;
+static const size_t MAX_REQUEST = 16 * 1024;  // HTTP header 上限
+static const size_t MAX_BACKLOG = 256 * 1024; // 每條 WebSocket 連線允許積壓的輸出
+
+struct Connection {
+	socket_t sock = INVALID_SOCKET_VAL;
+	std::string in;
+	std::string out;
+	bool websocket = false;
+	uint32_t streams = WebSocketServer::STREAM_BARS;
+	bool close_after_flush = false;
+	bool dead = false;
+};
+
+struct HttpRequest {
+	std::string method;
+	std::string path;
+	std::string websocket_key;
+	std::string accept_encoding;
+	std::string if_none_match;
+	bool close = false;
+};
+
+static void set_nonblocking(socket_t s)
+{
+#ifdef _WIN32
+	u_long mode = 1;
+	ioctlsocket(s, FIONBIO, &mode);
+#else
+	int flags = fcntl(s, F_GETFL, 0);
+	if (flags != -1)
+		fcntl(s, F_SETFL, flags | O_NONBLOCK);
+#endif
+}
+
+static bool would_block()
+{
+#ifdef _WIN32
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+static void flush(Connection &c)
+{
+	size_t sent_total = 0;
+	while (sent_total < c.out.size()) {
+		int n = send(c.sock, c.out.data() + sent_total, (int)(c.out.size() - sent_total), SEND_FLAGS);
+		if (n > 0) {
+			sent_total += (size_t)n;
+			continue;
+		}
+		if (n < 0 && would_block())
+			break;
+		c.dead = true;
+		break;
+	}
+	c.out.erase(0, sent_total);
+}
+
+static void append_ws_frame(std::string &out, unsigned char opcode, const char *data, size_t len)
+{
+	// FIN=1，伺服器端不做 masking
+	out.push_back((char)(0x80 | opcode));
+	if (len < 126) {
+		out.push_back((char)len);
+	} else if (len <= 0xFFFF) {
+		out.push_back(126);
+		out.push_back((char)((len >> 8) & 0xFF));
+		out.push_back((char)(len & 0xFF));
+	} else {
+		out.push_back(127);
+		for (int i = 7; i >= 0; --i)
+			out.push_back((char)((len >> (i * 8)) & 0xFF));
+	}
+	out.append(data, len);
+}
+
+// 從 c.in 取出一個完整的用戶端 frame（用戶端送來的一定有 mask）。
+// 資料不足時回傳 false；格式錯誤或過大時標記 dead。
+static bool next_ws_message(Connection &c, int &opcode, std::string &payload)
+{
+	const std::string &in = c.in;
+	if (in.size() < 2)
+		return false;
+	const unsigned char b0 = (unsigned char)in[0];
+	const unsigned char b1 = (unsigned char)in[1];
+	size_t len = b1 & 0x7F;
+	size_t pos = 2;
+	if (len == 126) {
+		if (in.size() < 4)
+			return false;
+		len = ((size_t)(unsigned char)in[2] << 8) | (unsigned char)in[3];
+		pos = 4;
+	} else if (len == 127) {
+		if (in.size() < 10)
+			return false;
+		uint64_t l = 0;
+		for (int i = 0; i < 8; ++i)
+			l = (l << 8) | (unsigned char)in[2 + i];
+		if (l > MAX_REQUEST) {
+			c.dead = true;
+			return false;
+		}
+		len = (size_t)l;
+		pos = 10;
 	}
+	if (!(b1 & 0x80) || len > MAX_REQUEST) {
+		c.dead = true;
+		return false;
+	}
+	if (in.size() < pos + 4 + len)
+		return false;
+
+	const unsigned char *mask = (const unsigned char *)in.data() + pos;
+	pos += 4;
+	payload.resize(len);
+	for (size_t i = 0; i < len; ++i)
+		payload[i] = (char)((unsigned char)in[pos + i] ^ mask[i & 3]);
+	opcode = b0 & 0x0F;
+	c.in.erase(0, pos + len);
 	return true;
 }
 
+// 極簡 JSON 取值：只找 "key": 後面的數字或字串，足以應付用戶端的小指令
+static bool json_number(const std::string &text, const char *key, double &out)
+{
+	std::string pattern = std::string("\"") + key + "\"";
+	size_t pos = text.find(pattern);
+	if (pos == std::string::npos)
+		return false;
+	pos = text.find(':', pos + pattern.size());
+	if (pos == std::string::npos)
+		return false;
+	const char *start = text.c_str() + pos + 1;
+	char *end = nullptr;
+	double v = strtod(start, &end);
+	if (end == start)
+		return false;
+	out = v;
+	return true;
+}
+
+static bool json_string_equals(const std::string &text, const char *key, const char *value)
+{
+	std::string pattern = std::string("\"") + key + "\"";
+	size_t pos = text.find(pattern);
+	if (pos == std::string::npos)
+		return false;
+	pos = text.find(':', pos + pattern.size());
+	if (pos == std::string::npos)
+		return false;
+	pos = text.find('"', pos);
+	if (pos == std::string::npos)
+		return false;
+	std::string expected = std::string(value) + "\"";
+	return text.compare(pos + 1, expected.size(), expected) == 0;
+}
+
+// 解析 "streams":[...] 中列出的資料流名稱
+static uint32_t json_streams(const std::string &text)
+{
+	uint32_t mask = 0;
+	size_t pos = text.find("\"streams\"");
+	if (pos == std::string::npos)
+		return mask;
+	size_t open = text.find('[', pos);
+	size_t close = open == std::string::npos ? open : text.find(']', open);
+	if (close == std::string::npos)
+		return mask;
+	std::string list = text.substr(open, close - open);
+	if (list.find("\"bars\"") != std::string::npos)
+		mask |= WebSocketServer::STREAM_BARS;
+	if (list.find("\"chroma\"") != std::string::npos)
+		mask |= WebSocketServer::STREAM_CHROMA;
+	if (list.find("\"features\"") != std::string::npos)
+		mask |= WebSocketServer::STREAM_FEATURES;
+	return mask;
+}
+
+static std::string trim(const std::string &s)
+{
+	size_t first = s.find_first_not_of(" \t");
+	if (first == std::string::npos)
+		return std::string();
+	size_t last = s.find_last_not_of(" \t");
+	return s.substr(first, last - first + 1);
+}
+
+static void parse_request(const std::string &head, HttpRequest &req)
+{
+	size_t pos = 0;
+	bool first_line = true;
+	while (pos <= head.size()) {
+		size_t eol = head.find("\r\n", pos);
+		if (eol == std::string::npos)
+			eol = head.size();
+		std::string line = head.substr(pos, eol - pos);
+		pos = eol + 2;
+
+		if (first_line) {
+			first_line = false;
+			std::istringstream iss(line);
+			std::string target;
+			iss >> req.method >> target;
+			req.path = target.substr(0, target.find('?'));
+			continue;
+		}
+
+		size_t colon = line.find(':');
+		if (colon == std::string::npos)
+			continue;
+		std::string name = line.substr(0, colon);
+		for (char &ch : name)
+			ch = (char)tolower((unsigned char)ch);
+		std::string value = trim(line.substr(colon + 1));
+		if (name == "sec-websocket-key")
+			req.websocket_key = value;
+		else if (name == "accept-encoding")
+			req.accept_encoding = value;
+		else if (name == "if-none-match")
+			req.if_none_match = value;
+		else if (name == "connection")
+			req.close = value.find("close") != std::string::npos;
+	}
+}
+
+// Accept-Encoding 是否接受某個編碼（忽略 q 值的細節，只排除 q=0）
+static bool accepts_encoding(const std::string &header, const char *coding)
+{
+	size_t pos = 0;
+	while (pos < header.size()) {
+		size_t comma = header.find(',', pos);
+		if (comma == std::string::npos)
+			comma = header.size();
+		std::string item = trim(header.substr(pos, comma - pos));
+		pos = comma + 1;
+
+		size_t semi = item.find(';');
+		std::string token = trim(item.substr(0, semi));
+		if (token != coding)
+			continue;
+		if (semi != std::string::npos) {
+			std::string params = item.substr(semi + 1);
+			params.erase(std::remove(params.begin(), params.end(), ' '), params.end());
+			if (params == "q=0" || params == "q=0.0" || params == "q=0.00" || params == "q=0.000")
+				return false;
+		}
+		return true;
+	}
+	return false;
+}
+
+static void append_simple_response(std::string &out, const char *status, bool close)
+{
+	char head[256];
+	snprintf(head, sizeof(head),
+		 "HTTP/1.1 %s\r\nContent-Type: text/plain; charset=utf-8\r\nContent-Length: %d\r\n"
+		 "Connection: %s\r\n\r\n%s",
+		 status, (int)strlen(status), close ? "close" : "keep-alive", status);
+	out += head;
+}
+
+static void serve_asset(Connection &c, const HttpRequest &req, const AssetCache &assets)
+{
+	const bool head_only = req.method == "HEAD";
+	if (req.method != "GET" && !head_only) {
+		append_simple_response(c.out, "405 Method Not Allowed", true);
+		c.close_after_flush = true;
+		return;
+	}
+
+	const WebAsset *asset = req.path.find("..") == std::string::npos ? assets.find(req.path) : nullptr;
+	if (!asset) {
+		append_simple_response(c.out, "404 Not Found", req.close);
+		c.close_after_flush = req.close;
+		return;
+	}
+
+	// 依序偏好 brotli > gzip > 原始內容；每種編碼有各自的強 ETag
+	const std::string *body = &asset->identity;
+	const char *encoding = nullptr;
+	if (!asset->brotli.empty() && accepts_encoding(req.accept_encoding, "br")) {
+		body = &asset->brotli;
+		encoding = "br";
+	} else if (!asset->gzip.empty() && accepts_encoding(req.accept_encoding, "gzip")) {
+		body = &asset->gzip;
+		encoding = "gzip";
+	}
+	std::string etag = asset->etag;
+	if (encoding) {
+		etag.insert(etag.size() - 1, "-");
+		etag.insert(etag.size() - 1, encoding[0] == 'b' ? "br" : "gz");
+	}
+
+	const bool not_modified = !req.if_none_match.empty() &&
+				  (req.if_none_match == "*" || req.if_none_match.find(etag) != std::string::npos);
+
+	std::string &out = c.out;
+	out += not_modified ? "HTTP/1.1 304 Not Modified\r\n" : "HTTP/1.1 200 OK\r\n";
+	out += "Content-Type: " + asset->content_type + "\r\n";
+	out += "Cache-Control: " + asset->cache_control + "\r\n";
+	out += "ETag: " + etag + "\r\n";
+	out += "Vary: Accept-Encoding\r\n";
+	if (encoding) {
+		out += "Content-Encoding: ";
+		out += encoding;
+		out += "\r\n";
+	}
+	if (!not_modified)
+		out += "Content-Length: " + std::to_string(body->size()) + "\r\n";
+	out += req.close ? "Connection: close\r\n\r\n" : "Connection: keep-alive\r\n\r\n";
+	if (!not_modified && !head_only)
+		out += *body;
+
+	c.close_after_flush = req.close;
+}
+
+static bool handle_websocket_upgrade(Connection &c, const HttpRequest &req);
+
+// 處理緩衝中所有完整的 HTTP 請求（支援 keep-alive）。
+// 回傳 true 表示這條連線剛完成 WebSocket 握手。
+static bool handle_http(Connection &c, const AssetCache &assets)
+{
+	while (!c.close_after_flush && !c.dead) {
+		size_t end = c.in.find("\r\n\r\n");
+		if (end == std::string::npos) {
+			if (c.in.size() > MAX_REQUEST)
+				c.dead = true;
+			return false;
+		}
+
+		HttpRequest req;
+		parse_request(c.in.substr(0, end), req);
+		c.in.erase(0, end + 4);
+
+		if (!req.websocket_key.empty()) {
+			bool ok = handle_websocket_upgrade(c, req);
+			flush(c);
+			return ok;
+		}
+
+		ws_blog(LOG_DEBUG, "HTTP %s %s", req.method.c_str(), req.path.c_str());
+		serve_asset(c, req, assets);
+		flush(c);
+	}
+	return false;
+}
+
 // 極簡 base64 實作
 static const char *B64 = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
@@ -237,179 +659,464 @@ static std::string websocket_accept_key(const std::string &client_key)
 	return base64_encode(digest, 20);
 }
 
-std::string WebSocketServer::build_frame()
+static bool handle_websocket_upgrade(Connection &c, const HttpRequest &req)
+{
+	std::string accept_key = websocket_accept_key(req.websocket_key);
+	ws_blog(LOG_INFO, "%s", "WebSocket client connected");
+	ws_blog(LOG_DEBUG, "Client Sec-WebSocket-Key: %s, Sec-WebSocket-Accept: %s", req.websocket_key.c_str(),
+		accept_key.c_str());
+
+	std::ostringstream resp;
+	resp << "HTTP/1.1 101 Switching Protocols\r\n";
+	resp << "Upgrade: websocket\r\n";
+	resp << "Connection: Upgrade\r\n";
+	resp << "Sec-WebSocket-Accept: " << accept_key << "\r\n\r\n";
+	c.out += resp.str();
+	c.websocket = true;
+	return true;
+}
+
+// JSON 數字一律用 to_chars：snprintf 受 LC_NUMERIC 影響，OBS 在逗號小數點的語系下
+// 會輸出 "0,5"，整個 frame 就無法解析。非有限值以 0 代替
+static void append_number(std::string &out, double v, std::chars_format format, int precision)
+{
+	if (!std::isfinite(v))
+		v = 0.0;
+	char num[64];
+	std::to_chars_result res = std::to_chars(num, num + sizeof(num), v, format, precision);
+	out.append(num, res.ptr);
+}
+
+// 毫秒時間戳記，保留一位小數
+static void append_time(std::string &out, uint64_t time_ns)
+{
+	append_number(out, (double)time_ns / 1e6, std::chars_format::fixed, 1);
+}
+
+void WebSocketServer::build_frame(std::string &frame)
 {
 	// 構造簡單 text frame: FIN=1, opcode=1, 無 masking
-	std::array<float, 12> bars_copy;
+	std::array<float, BandLayout::MAX_BANDS> bars_copy;
+	size_t count = 0;
+	uint64_t time_ns = 0;
 	{
 		std::lock_guard<std::mutex> lock(m_data_mutex);
-		bars_copy = m_bars;
+		count = m_bar_count;
+		time_ns = m_bars_time;
+		std::copy(m_bars.begin(), m_bars.begin() + count, bars_copy.begin());
 	}
 
-	std::ostringstream oss;
-	oss << "{\"bars\":[";
-	for (size_t i = 0; i < bars_copy.size(); ++i) {
-		if (i) oss << ',';
+	// {"t":ms,"q":level,"bands":N,"bars":[...]}。m_payload 與 frame 都跨推送重複使用，容量夠了之後不再配置
+	std::string &payload = m_payload;
+	payload.clear();
+	payload += "{\"t\":";
+	append_time(payload, time_ns);
+	payload += ",\"q\":";
+	payload += std::to_string(m_quality.load());
+	payload += ",\"bands\":";
+	payload += std::to_string(count);
+	payload += ",\"bars\":[";
+	for (size_t i = 0; i < count; ++i) {
 		float v = bars_copy[i];
 		if (v < 0.0f) v = 0.0f;
 		if (v > 1.0f) v = 1.0f;
-		oss << v;
+		if (i)
+			payload += ',';
+		append_number(payload, v, std::chars_format::general, 4);
 	}
-	oss << "]}";
-	std::string payload = oss.str();
+	payload += "]}";
 
-	std::string frame;
-	frame.push_back((char)0x81); // FIN + text
-	size_t len = payload.size();
-	if (len < 126) {
-		frame.push_back((char)len);
-	} else if (len <= 0xFFFF) {
-		frame.push_back(126);
-		frame.push_back((char)((len >> 8) & 0xFF));
-		frame.push_back((char)(len & 0xFF));
-	} else {
-		frame.push_back(127);
-		for (int i = 7; i >= 0; --i)
-			frame.push_back((char)((len >> (i * 8)) & 0xFF));
+	frame.clear();
+	append_ws_frame(frame, 0x1, payload.data(), payload.size());
+}
+
+void WebSocketServer::build_chroma_frame(std::string &frame)
+{
+	std::array<float, 12> chroma;
+	uint64_t time_ns = 0;
+	{
+		std::lock_guard<std::mutex> lock(m_data_mutex);
+		chroma = m_chroma;
+		time_ns = m_chroma_time;
+	}
+
+	std::string &payload = m_payload;
+	payload.clear();
+	payload += "{\"type\":\"chroma\",\"t\":";
+	append_time(payload, time_ns);
+	payload += ",\"chroma\":[";
+	for (size_t i = 0; i < chroma.size(); ++i) {
+		float v = chroma[i];
+		if (v < 0.0f) v = 0.0f;
+		if (v > 1.0f) v = 1.0f;
+		if (i)
+			payload += ',';
+		append_number(payload, v, std::chars_format::general, 3);
+	}
+	payload += "]}";
+
+	frame.clear();
+	append_ws_frame(frame, 0x1, payload.data(), payload.size());
+}
+
+void WebSocketServer::build_features_frame(std::string &frame)
+{
+	std::array<float, FEATURE_COUNT> features;
+	uint64_t time_ns = 0;
+	{
+		std::lock_guard<std::mutex> lock(m_data_mutex);
+		features = m_features;
+		time_ns = m_features_time;
+		m_features_folded = 0;
+	}
+
+	// {"type":"features","t":ms,"f":[centroid,rolloff,flatness,flux,zcr,crest]}
+	std::string &payload = m_payload;
+	payload.clear();
+	payload += "{\"type\":\"features\",\"t\":";
+	append_time(payload, time_ns);
+	payload += ",\"f\":[";
+	for (size_t i = 0; i < features.size(); ++i) {
+		if (i)
+			payload += ',';
+		append_number(payload, features[i], std::chars_format::general, 4);
+	}
+	payload += "]}";
+
+	frame.clear();
+	append_ws_frame(frame, 0x1, payload.data(), payload.size());
+}
+
+void WebSocketServer::append_history(std::string &out, uint64_t since_ms, uint64_t until_ms)
+{
+	std::string payload;
+	{
+		std::lock_guard<std::mutex> lock(m_data_mutex);
+		if (!m_history.enabled())
+			return;
+		m_history.encode(payload, clock_ms(), since_ms, until_ms);
+	}
+	append_ws_frame(out, 0x2, payload.data(), payload.size());
+}
+
+void WebSocketServer::handle_client_message(std::string &out, uint32_t &streams, const std::string &text)
+{
+	// {"type":"subscribe","streams":["bars","chroma","features"]}：以列出的資料流取代目前的訂閱
+	if (json_string_equals(text, "type", "subscribe")) {
+		streams = json_streams(text);
+		return;
 	}
-	frame += payload;
-	return frame;
+
+	// {"type":"history","since":10000,"until":0}：since / until 為距今毫秒數，省略時取全部
+	if (json_string_equals(text, "type", "history")) {
+		double since = -1.0;
+		double until = 0.0;
+		json_number(text, "since", since);
+		json_number(text, "until", until);
+		if (!std::isfinite(since) || !std::isfinite(until)) {
+			ws_blog(LOG_DEBUG, "Ignoring history query with a non-finite range: %s", text.c_str());
+			return;
+		}
+		// 先夾在歷史長度內再轉型，任意大的數字不會溢位。
+		// since 超過歷史長度等同全部（靜音缺口會讓最舊的幀比長度更舊）
+		uint64_t limit_ms;
+		{
+			std::lock_guard<std::mutex> lock(m_data_mutex);
+			limit_ms = m_history_ms;
+		}
+		uint64_t since_ms = (since < 0.0 || since >= (double)limit_ms) ? UINT64_MAX : (uint64_t)since;
+		uint64_t until_ms = until <= 0.0 ? 0 : (until >= (double)limit_ms ? limit_ms : (uint64_t)until);
+		// 和推送相同的積壓上限：不讀取的用戶端重複查詢時不再替它緩衝整段歷史
+		if (out.size() > MAX_BACKLOG) {
+			ws_blog(LOG_DEBUG, "%s", "Dropping history query, client is not reading");
+			return;
+		}
+		append_history(out, since_ms, until_ms);
+		return;
+	}
+	ws_blog(LOG_DEBUG, "Ignoring client message: %s", text.c_str());
 }
 
-void WebSocketServer::run(uint16_t port)
+void WebSocketServer::run(uint16_t port, std::promise<bool> &ready)
 {
 #ifdef _WIN32
 	WSADATA wsa;
 	if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
 		ws_blog(LOG_ERROR, "WSAStartup failed (err=%d)", WSAGetLastError());
-		m_running = false;
+		ready.set_value(false);
 		return;
 	}
 #endif
 
+	// 前端檔案只在這裡讀一次，之後全部從記憶體回應
+	if (!m_asset_root.empty()) {
+		size_t files = m_assets.load_directory(m_asset_root);
+		ws_blog(LOG_INFO, "Loaded %d widget files (%d KB incl. compressed variants) from %s", (int)files,
+			(int)(m_assets.memory_usage() / 1024), m_asset_root.c_str());
+	}
+
 	socket_t listen_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
 	if (listen_sock == INVALID_SOCKET_VAL) {
 #ifdef _WIN32
 		ws_blog(LOG_ERROR, "socket() failed (err=%d)", WSAGetLastError());
 		WSACleanup();
 #endif
-		m_running = false;
+		ready.set_value(false);
 		return;
 	}
 
 	sockaddr_in addr{};
 	addr.sin_family = AF_INET;
-	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK); // 127.0.0.1
 	addr.sin_port = htons(port);
+	const char *bind_address = m_bind_address.c_str();
+	if (inet_pton(AF_INET, bind_address, &addr.sin_addr) != 1) {
+		ws_blog(LOG_ERROR, "Invalid bind address '%s'", bind_address);
+		CLOSESOCKET(listen_sock);
+#ifdef _WIN32
+		WSACleanup();
+#endif
+		ready.set_value(false);
+		return;
+	}
 
 	int yes = 1;
 	setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, (const char *)&yes, sizeof(yes));
 
 	if (bind(listen_sock, (sockaddr *)&addr, sizeof(addr)) == SOCKET_ERROR) {
 #ifdef _WIN32
-		ws_blog(LOG_ERROR, "bind() failed on 127.0.0.1:%d (err=%d)", (int)port, WSAGetLastError());
+		ws_blog(LOG_ERROR, "bind() failed on %s:%d (err=%d)", bind_address, (int)port, WSAGetLastError());
 #else
-		ws_blog(LOG_ERROR, "bind() failed on 127.0.0.1:%d", (int)port);
+		ws_blog(LOG_ERROR, "bind() failed on %s:%d", bind_address, (int)port);
 #endif
 		CLOSESOCKET(listen_sock);
 #ifdef _WIN32
 		WSACleanup();
 #endif
-		m_running = false;
+		ready.set_value(false);
+		return;
+	}
+
+	if (listen(listen_sock, 16) == SOCKET_ERROR) {
+		ws_blog(LOG_ERROR, "listen() failed on %s:%d", bind_address, (int)port);
+		CLOSESOCKET(listen_sock);
+#ifdef _WIN32
+		WSACleanup();
+#endif
+		ready.set_value(false);
 		return;
 	}
+	set_nonblocking(listen_sock);
+	ws_blog(LOG_INFO, "HTTP/WebSocket server listening on %s:%d", bind_address, (int)port);
+	ready.set_value(true);
 
-	listen(listen_sock, 1);
-	ws_blog(LOG_INFO, "WebSocket server listening on 127.0.0.1:%d", (int)port);
+	// 喚醒用的 UDP socket 對：recv 端放進 select，send 端交給其他執行緒
+	socket_t wake_recv = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	socket_t wake_send = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (wake_recv != INVALID_SOCKET_VAL && wake_send != INVALID_SOCKET_VAL) {
+		sockaddr_in wake_addr{};
+		wake_addr.sin_family = AF_INET;
+		wake_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		wake_addr.sin_port = 0;
+#ifdef _WIN32
+		int wake_len = sizeof(wake_addr);
+#else
+		socklen_t wake_len = sizeof(wake_addr);
+#endif
+		if (bind(wake_recv, (sockaddr *)&wake_addr, sizeof(wake_addr)) != SOCKET_ERROR &&
+		    getsockname(wake_recv, (sockaddr *)&wake_addr, &wake_len) != SOCKET_ERROR &&
+		    connect(wake_send, (sockaddr *)&wake_addr, sizeof(wake_addr)) != SOCKET_ERROR) {
+			set_nonblocking(wake_recv);
+			set_nonblocking(wake_send);
+			m_wake_sock = (intptr_t)wake_send;
+		}
+	}
+
+	std::vector<Connection> conns;
+	const auto frame_interval = std::chrono::milliseconds(60);    // 約 16 FPS
+	const auto silent_interval = std::chrono::milliseconds(1000); // 靜音時的 keep-alive
+	auto next_push = std::chrono::steady_clock::now();
 
 	while (m_running.load()) {
 		fd_set readfds;
+		fd_set writefds;
 		FD_ZERO(&readfds);
+		FD_ZERO(&writefds);
 		FD_SET(listen_sock, &readfds);
+		socket_t max_sock = listen_sock;
+		if (m_wake_sock.load() != -1) {
+			FD_SET(wake_recv, &readfds);
+			max_sock = std::max(max_sock, wake_recv);
+		}
+		bool any_ws = false;
+		for (const Connection &c : conns) {
+			FD_SET(c.sock, &readfds);
+			if (!c.out.empty())
+				FD_SET(c.sock, &writefds);
+			max_sock = std::max(max_sock, c.sock);
+			any_ws = any_ws || c.websocket;
+		}
+
+		// 有訂閱者時等到下一次推送，否則只需定期檢查 m_running
+		auto now = std::chrono::steady_clock::now();
+		long long wait_us = 200000;
+		if (any_ws) {
+			auto until = std::chrono::duration_cast<std::chrono::microseconds>(next_push - now).count();
+			wait_us = std::max(0LL, std::min(wait_us, (long long)until));
+		}
 		timeval tv{};
-		tv.tv_sec = 0;
-		tv.tv_usec = 200000; // 200ms
-		int r = select((int)listen_sock + 1, &readfds, nullptr, nullptr, &tv);
-		if (r <= 0) {
+		tv.tv_sec = (long)(wait_us / 1000000);
+		tv.tv_usec = (long)(wait_us % 1000000);
+		int r = select((int)max_sock + 1, &readfds, &writefds, nullptr, &tv);
+		if (r < 0)
 			continue;
+
+		if (r > 0 && m_wake_sock.load() != -1 && FD_ISSET(wake_recv, &readfds)) {
+			char drain[64];
+			while (recv(wake_recv, drain, sizeof(drain), 0) > 0) {
+			}
+			next_push = std::chrono::steady_clock::now();
 		}
-		if (!FD_ISSET(listen_sock, &readfds))
-			continue;
 
-		sockaddr_in client_addr{};
-	#ifdef _WIN32
-		int client_len = sizeof(client_addr);
-	#else
-		socklen_t client_len = sizeof(client_addr);
-	#endif
-		socket_t client = accept(listen_sock, (sockaddr *)&client_addr, &client_len);
-		if (client == INVALID_SOCKET_VAL) {
+		if (r > 0 && FD_ISSET(listen_sock, &readfds)) {
+			while (true) {
+				sockaddr_in client_addr{};
 #ifdef _WIN32
-			ws_blog(LOG_WARNING, "accept() failed (err=%d)", WSAGetLastError());
+				int client_len = sizeof(client_addr);
+#else
+				socklen_t client_len = sizeof(client_addr);
 #endif
-			continue;
-		}
-		ws_blog(LOG_INFO, "%s", "Client accepted for WebSocket handshake");
-
-		// WebSocket handshake
-		std::string line;
-		std::string key;
-		while (recv_line(client, line)) {
-			ws_blog(LOG_INFO, "Handshake line: %s", line.c_str());
-			if (line.empty()) break; // headers end
-			const std::string prefix = "Sec-WebSocket-Key:";
-			if (line.rfind(prefix, 0) == 0) {
-				key = line.substr(prefix.size());
-				// trim
-				size_t first = key.find_first_not_of(" \t");
-				size_t last = key.find_last_not_of(" \t");
-				if (first != std::string::npos)
-					key = key.substr(first, last - first + 1);
+				socket_t client = accept(listen_sock, (sockaddr *)&client_addr, &client_len);
+				if (client == INVALID_SOCKET_VAL)
+					break;
+				if (conns.size() >= MAX_CONNECTIONS) {
+					ws_blog(LOG_WARNING, "%s", "Too many connections, dropping client");
+					CLOSESOCKET(client);
+					continue;
+				}
+				set_nonblocking(client);
+				setsockopt(client, IPPROTO_TCP, TCP_NODELAY, (const char *)&yes, sizeof(yes));
+				Connection c;
+				c.sock = client;
+				conns.push_back(std::move(c));
 			}
 		}
-		ws_blog(LOG_INFO, "Handshake header parse finished, key_len=%d", (int)key.size());
-		if (key.empty()) {
-			ws_blog(LOG_WARNING, "%s", "Handshake missing Sec-WebSocket-Key, closing client");
-			CLOSESOCKET(client);
-			continue;
+
+		for (Connection &c : conns) {
+			if (c.dead || r <= 0)
+				continue;
+			if (FD_ISSET(c.sock, &readfds)) {
+				char buf[4096];
+				int n = recv(c.sock, buf, sizeof(buf), 0);
+				if (n <= 0) {
+					if (n == 0 || !would_block())
+						c.dead = true;
+					continue;
+				}
+				c.in.append(buf, (size_t)n);
+				if (c.websocket) {
+					int opcode = 0;
+					std::string message;
+					while (!c.dead && next_ws_message(c, opcode, message)) {
+						if (opcode == 0x1) {
+							handle_client_message(c.out, c.streams, message);
+						} else if (opcode == 0x8) {
+							append_ws_frame(c.out, 0x8, message.data(), std::min<size_t>(message.size(), 2));
+							c.close_after_flush = true;
+						} else if (opcode == 0x9) {
+							append_ws_frame(c.out, 0xA, message.data(), message.size());
+						}
+					}
+					flush(c);
+				} else if (handle_http(c, m_assets)) {
+					m_subscribers++;
+					// 新訂閱者先收到一則歷史 backfill，並立即收到一幀
+					append_history(c.out, UINT64_MAX, 0);
+					flush(c);
+					next_push = std::chrono::steady_clock::now();
+				}
+			}
+			if (FD_ISSET(c.sock, &writefds))
+				flush(c);
 		}
 
-		std::string accept_key = websocket_accept_key(key);
-		ws_blog(LOG_INFO, "Client Sec-WebSocket-Key: %s", key.c_str());
-		ws_blog(LOG_INFO, "Computed Sec-WebSocket-Accept: %s", accept_key.c_str());
-		ws_blog(LOG_DEBUG, "%s", "Sec-WebSocket-Key received, sending 101 response");
-		std::ostringstream resp;
-		resp << "HTTP/1.1 101 Switching Protocols\r\n";
-		resp << "Upgrade: websocket\r\n";
-		resp << "Connection: Upgrade\r\n";
-		resp << "Sec-WebSocket-Accept: " << accept_key << "\r\n\r\n";
-		std::string resp_str = resp.str();
-		int hs_sent = send(client, resp_str.c_str(), (int)resp_str.size(), 0);
-		if (hs_sent <= 0) {
-#ifdef _WIN32
-			ws_blog(LOG_ERROR, "Handshake send() failed (err=%d)", WSAGetLastError());
-#endif
-			CLOSESOCKET(client);
-			continue;
+		// 推送頻譜：所有訂閱者共用同一個 frame
+		now = std::chrono::steady_clock::now();
+		if (now >= next_push) {
+			bool silent;
+			{
+				std::lock_guard<std::mutex> lock(m_data_mutex);
+				silent = m_silent;
+			}
+			if (any_ws) {
+				// 沒有人訂閱的資料流留空（這一輪才訂閱的連線下一次推送才會收到）
+				const uint32_t mask = m_stream_mask.load();
+				std::string &frame = m_bars_frame;
+				std::string &chroma = m_chroma_frame;
+				std::string &features = m_features_frame;
+				if (mask & STREAM_BARS)
+					build_frame(frame);
+				else
+					frame.clear();
+				if (mask & STREAM_CHROMA)
+					build_chroma_frame(chroma);
+				else
+					chroma.clear();
+				if (mask & STREAM_FEATURES)
+					build_features_frame(features);
+				else
+					features.clear();
+				for (Connection &c : conns) {
+					if (!c.websocket || c.dead)
+						continue;
+					// 用戶端來不及收時直接丟幀，避免積壓
+					if (c.out.size() > MAX_BACKLOG)
+						continue;
+					if (c.streams & STREAM_BARS)
+						c.out += frame;
+					if (c.streams & STREAM_CHROMA)
+						c.out += chroma;
+					if (c.streams & STREAM_FEATURES)
+						c.out += features;
+					flush(c);
+				}
+			}
+			next_push = now + (silent ? silent_interval : frame_interval);
 		}
 
-		// 簡單的推送 loop：直到連線關閉或伺服器停止
-		while (m_running.load()) {
-			std::string frame = build_frame();
-			int sent = send(client, frame.data(), (int)frame.size(), 0);
-			if (sent <= 0) {
-#ifdef _WIN32
-				ws_blog(LOG_INFO, "send() to client failed/closed (err=%d)", WSAGetLastError());
-#endif
-				break;
+		// 回收已關閉的連線
+		for (Connection &c : conns) {
+			if (c.close_after_flush && c.out.empty())
+				c.dead = true;
+			if (c.dead) {
+				if (c.websocket) {
+					m_subscribers--;
+					ws_blog(LOG_INFO, "%s", "WebSocket client disconnected");
+				}
+				CLOSESOCKET(c.sock);
 			}
-			std::this_thread::sleep_for(std::chrono::milliseconds(60)); // 約 16 FPS
 		}
+		conns.erase(std::remove_if(conns.begin(), conns.end(), [](const Connection &c) { return c.dead; }),
+			    conns.end());
 
-		CLOSESOCKET(client);
-		ws_blog(LOG_INFO, "%s", "Client disconnected");
+		uint32_t mask = 0;
+		for (const Connection &c : conns) {
+			if (c.websocket)
+				mask |= c.streams;
+		}
+		m_stream_mask = mask;
 	}
+	m_stream_mask = 0;
 
+	for (Connection &c : conns) {
+		if (c.websocket)
+			m_subscribers--;
+		CLOSESOCKET(c.sock);
+	}
+	m_wake_sock = -1;
+	if (wake_send != INVALID_SOCKET_VAL)
+		CLOSESOCKET(wake_send);
+	if (wake_recv != INVALID_SOCKET_VAL)
+		CLOSESOCKET(wake_recv);
 	CLOSESOCKET(listen_sock);
 #ifdef _WIN32
 	WSACleanup();
@@ -2,35 +2,117 @@
 
 #include <array>
 #include <atomic>
+#include <future>
 #include <mutex>
 #include <thread>
 #include <vector>
 #include <string>
 #include <cstdint>
 
-// 非高性能實作，只面向本機單用戶場景，足夠驅動 widget。
+#include "asset_cache.hpp"
+#include "band_layout.hpp"
+#include "features.hpp"
+#include "spectrum_history.hpp"
+
+// 非高性能實作，只面向本機少量連線場景，足夠驅動 widget。
+// 同一個 port 上同時提供前端靜態檔（HTTP）與頻譜推送（WebSocket）。
 
 class WebSocketServer {
 public:
+	// 用戶端可訂閱的資料流，預設只有 bars。
+	// 訂閱指令：{"type":"subscribe","streams":["bars","chroma","features"]}
+	static const uint32_t STREAM_BARS = 1u << 0;
+	static const uint32_t STREAM_CHROMA = 1u << 1;
+	static const uint32_t STREAM_FEATURES = 1u << 2;
+
 	WebSocketServer();
 	~WebSocketServer();
 
+	// 前端檔案所在目錄，需在 start() 前設定；伺服器執行緒啟動時一次載入記憶體
+	void setAssetRoot(const std::string &root);
+	// 監聽的 IPv4 位址，預設只接受本機連線；需在 start() 前設定
+	void setBindAddress(const std::string &address);
+	// setBars 等傳入的時間戳記所用的單調時鐘（ns），歷史的距今毫秒數以同一個時鐘計算，
+	// 與 "t" 可以直接對齊。預設為 steady_clock；需在 start() 前設定
+	void setClock(uint64_t (*now_ns)());
+
+	// 開始監聽；bind / listen 失敗（例如 port 已被占用）時回傳 false，伺服器不會執行
 	bool start(uint16_t port);
 	void stop();
 
-	void setBars(const std::array<float, 12> &bars);
+	// bars 長度為 count（最多 BandLayout::MAX_BANDS），frame 會帶上頻段數。
+	// timestamp_ns 為這一幀應該被看到的時間（setClock 的時鐘），以毫秒 "t" 送出。
+	// 起點不固定，用戶端只能用相鄰兩幀的差值
+	void setBars(const float *bars, size_t count, uint64_t timestamp_ns);
+
+	// 歷史緩衝長度（秒，0 停用）與量化精度（8 / 16 bit）。
+	// 新訂閱者會先收到一則 backfill，之後可用 {"type":"history","since":ms,"until":ms} 查詢範圍。
+	// 歷史由 setBars 記錄，只涵蓋有人訂閱的期間；靜音時不重複送出歸零的 bar，缺口即為靜音
+	void setHistory(double seconds, int bits);
+
+	// 12 個音級（0..1），只推送給訂閱了 chroma 的用戶端
+	void setChroma(const float *chroma, uint64_t timestamp_ns);
+
+	// FEATURE_COUNT 個特徵描述（順序見 features.hpp），只推送給訂閱了 features 的用戶端。
+	// 兩次推送之間的多筆以 fold_features 合併
+	void setFeatures(const float *features, uint64_t timestamp_ns);
+
+	// 分析的品質等級（0 為完整），隨 bars frame 以 "q" 送出，讓前端知道目前降級了多少
+	void setQuality(int level) { m_quality.store(level); }
+
+	// 目前是否有已完成握手的 WebSocket 用戶端
+	bool hasSubscribers() const { return m_subscribers.load() > 0; }
+	// 是否有任何用戶端訂閱了指定資料流，可用來略過不需要的分析
+	bool wantsStream(uint32_t stream) const { return (m_stream_mask.load() & stream) != 0; }
 
 private:
 	std::atomic<bool> m_running{false};
+	std::atomic<int> m_subscribers{0};
+	std::atomic<uint32_t> m_stream_mask{0};
+	std::atomic<int> m_quality{0};
 	std::thread m_thread;
 
+	std::string m_asset_root;
+	uint64_t (*m_clock)();
+	uint64_t clock_ms() const { return m_clock() / 1000000ULL; }
+	std::string m_bind_address = "127.0.0.1";
+	AssetCache m_assets; // 只在伺服器執行緒使用
+
 	std::mutex m_data_mutex;
-	std::array<float, 12> m_bars{};
+	std::array<float, BandLayout::MAX_BANDS> m_bars{};
+	size_t m_bar_count = 0;
+	uint64_t m_bars_time = 0;
+	bool m_silent = false; // 全部 bar 為 0 時降低推送頻率
+	std::array<float, 12> m_chroma{};
+	uint64_t m_chroma_time = 0;
+	std::array<float, FEATURE_COUNT> m_features{};
+	uint64_t m_features_time = 0;
+	size_t m_features_folded = 0; // 上次推送後合併進 m_features 的筆數
+	SpectrumHistory m_history;
+	uint64_t m_history_ms = 0; // 歷史長度，用來夾住用戶端查詢的範圍
+
+	// 從靜音恢復 / 停止時用來打斷 select() 的本機 UDP socket
+	// （已 connect 到伺服器執行緒的接收端，send 一個 byte 即可喚醒）
+	std::atomic<intptr_t> m_wake_sock{-1};
+	void wake();
+
+	// 監聽 socket 開好（或失敗）時透過 ready 通知 start()
+	void run(uint16_t port, std::promise<bool> &ready);
 
-	void run(uint16_t port);
+	// 以下僅伺服器執行緒使用，每次推送重複使用，不再逐幀配置
+	std::string m_payload; // JSON 本體
+	std::string m_bars_frame;
+	std::string m_chroma_frame;
+	std::string m_features_frame;
 
-	std::string build_frame();
+	// 把目前的資料編成完整的 WebSocket text frame，取代 frame 原本的內容
+	void build_frame(std::string &frame);
+	void build_chroma_frame(std::string &frame);
+	void build_features_frame(std::string &frame);
+	// 把 age 在 [until_ms, since_ms] 的歷史編成 binary frame 附加到 out
+	void append_history(std::string &out, uint64_t since_ms, uint64_t until_ms);
+	void handle_client_message(std::string &out, uint32_t &streams, const std::string &text);
 };
 
-// 提供一個全域單例，方便在來源內共用伺服器
+// 提供一個全域單例，方便在 OBS 來源內共用伺服器（定義於 module.cpp）
 WebSocketServer *GetGlobalWebSocketServer();